@@ -0,0 +1,600 @@
+//* 内存分配器基准测试：malloc、sgi_stl::Allocator 和 NgxMemPool
+//* 用法：bench [--iters N] [--threads N] [--bench 名字]
+//*   --iters    每个用例每个线程的操作数，默认 200000
+//*   --threads  多线程用例的最大线程数，默认为 CPU 数
+//*   --bench    只运行名字中包含该字符串的用例：size_class、scaling、producer_consumer、request、fragmentation
+//* 每个用例输出一行 JSON，第一行是运行环境，用 commit 字段区分不同提交的结果
+//* 每个用例在 fork 出的子进程中运行，RSS 和分配器的全局状态互不影响
+//* 对比 jemalloc、tcmalloc：LD_PRELOAD=/path/to/libjemalloc.so bin/bench，malloc_impl 字段记录 LD_PRELOAD
+//* 库和 bench 都应以 -DCMAKE_BUILD_TYPE=Release 编译，否则结果没有比较意义
+#include "ngx_mem_pool.hpp"
+#include "sgi_stl_mem_pool.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+namespace {
+
+const size_t kBatch = 1024;  //* 单线程用例先连续开辟 kBatch 个再全部释放
+
+struct Options {
+  uint64_t iters = 200000;
+  int maxThreads = 1;
+  std::string filter;
+} opt;
+
+inline uint64_t nowNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//* 对数线性直方图：小于 16ns 每纳秒一个桶，之后每个 2 的幂区间分 16 个桶，相对误差不超过 1/16
+class Histogram {
+public:
+  void add(uint64_t ns) {
+    ++counts_[index(ns)];
+    ++total_;
+  }
+
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < kBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+  }
+
+  //* 第 q 分位数所在桶的下界
+  uint64_t percentile(double q) const {
+    uint64_t rank = (uint64_t)(q * (double)total_);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen > rank) {
+        return value(i);
+      }
+    }
+    return value(kBuckets - 1);
+  }
+
+private:
+  static const size_t kBuckets = 61 * 16;
+
+  static size_t index(uint64_t v) {
+    if (v < 16) {
+      return (size_t)v;
+    }
+    unsigned e = 63 - (unsigned)__builtin_clzll(v);
+    return (size_t)(e - 3) * 16 + (size_t)((v >> (e - 4)) & 15);
+  }
+
+  static uint64_t value(size_t i) {
+    if (i < 16) {
+      return i;
+    }
+    unsigned e = (unsigned)(i / 16) + 3;
+    return (uint64_t)(16 + i % 16) << (e - 4);
+  }
+
+  uint64_t counts_[kBuckets] = {};
+  uint64_t total_ = 0;
+};
+
+size_t rssBytes() {
+  long size = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(f);
+  }
+  return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//* 用例开始以来增加的 RSS
+size_t rssDelta(size_t base) {
+  size_t now = rssBytes();
+  return now > base ? now - base : 0;
+}
+
+//* 一个用例的结果，输出为一行 JSON；ops 为开辟+释放的对数(request 用例为请求数)
+struct Result {
+  const char *bench = "";
+  const char *alloc = "";
+  size_t size = 0;
+  int threads = 1;
+  uint64_t ops = 0;
+  double seconds = 0;
+  const Histogram *latency = nullptr;
+  size_t rssGrowth = 0;
+  size_t liveBytes = 0;
+};
+
+void emit(const Result &r) {
+  printf("{\"commit\":\"%s\",\"bench\":\"%s\",\"alloc\":\"%s\",\"size\":%zu,\"threads\":%d,"
+         "\"ops\":%llu,\"seconds\":%.6f,\"mops\":%.3f",
+         BENCH_COMMIT, r.bench, r.alloc, r.size, r.threads, (unsigned long long)r.ops, r.seconds,
+         r.seconds > 0 ? (double)r.ops / r.seconds / 1e6 : 0.0);
+  if (r.latency) {
+    printf(",\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu",
+           (unsigned long long)r.latency->percentile(0.5), (unsigned long long)r.latency->percentile(0.99),
+           (unsigned long long)r.latency->percentile(0.999));
+  }
+  printf(",\"rss_delta_bytes\":%zu", r.rssGrowth);
+  if (r.liveBytes) {
+    printf(",\"live_bytes\":%zu,\"frag_ratio\":%.3f", r.liveBytes, (double)r.rssGrowth / (double)r.liveBytes);
+  }
+  printf("}\n");
+  fflush(stdout);
+}
+
+//* 在子进程中运行一个用例
+template <typename F>
+void isolated(const char *bench, F f) {
+  if (!opt.filter.empty() && strstr(bench, opt.filter.c_str()) == nullptr) {
+    return;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    f();
+    fflush(stdout);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "bench %s failed\n", bench);
+  }
+}
+
+//* 三种分配器的统一接口
+//* NgxMemPool 的小块内存不能单独释放，deallocate 只交还大块内存，batchEnd 时整体 ngxResetPool
+struct MallocAlloc {
+  static constexpr const char *kName = "malloc";
+  void *allocate(size_t n) { return malloc(n); }
+  void deallocate(void *p, size_t) { free(p); }
+  void batchEnd() {}
+};
+
+struct SgiAlloc {
+  static constexpr const char *kName = "sgi_stl";
+  void *allocate(size_t n) { return alloc_.allocate(n); }
+  void deallocate(void *p, size_t n) { alloc_.deallocate((char *)p, n); }
+  void batchEnd() {}
+  sgi_stl::Allocator<char> alloc_;
+};
+
+struct NgxAlloc {
+  static constexpr const char *kName = "ngx_mem_pool";
+  void *allocate(size_t n) { return pool_.ngxPalloc(n); }
+  void deallocate(void *p, size_t n) {
+    if (n > pool_.ngxMaxSmall()) {
+      pool_.ngxPfree(p);
+    }
+  }
+  void batchEnd() { pool_.ngxResetPool(); }
+  NgxMemPool pool_{64 * 1024};
+};
+
+//* 所有线程就绪后同时开始，最后到达的线程记下开始时间再放行
+//* 开始时间不由主线程在放行后读取，单核机器上工作线程可能在主线程再次被调度前就已跑完
+class StartGate {
+public:
+  explicit StartGate(int n) : waiting_(n) {}
+  void arriveAndWait() {
+    if (waiting_.fetch_sub(1) == 1) {
+      start_ = nowNs();
+      go_.store(true);
+    }
+    while (!go_.load()) {
+      std::this_thread::yield();
+    }
+  }
+  uint64_t startNs() const { return start_; }
+
+private:
+  std::atomic<int> waiting_;
+  std::atomic<bool> go_{false};
+  uint64_t start_ = 0;
+};
+
+//* 单线程按尺寸类别：连续开辟 kBatch 个 size 字节再全部释放
+//* 第一遍不计时每次操作，测吞吐；第二遍逐次计时，测开辟和释放的延迟分布
+template <typename A>
+void sizeClass(size_t size) {
+  A a;
+  std::vector<void *> ptrs(kBatch);
+  size_t base = rssBytes();
+  uint64_t rounds = (opt.iters + kBatch - 1) / kBatch;
+
+  uint64_t t0 = nowNs();
+  for (uint64_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      ptrs[i] = a.allocate(size);
+      *(volatile char *)ptrs[i] = (char)i;
+    }
+    for (size_t i = 0; i < kBatch; ++i) {
+      a.deallocate(ptrs[i], size);
+    }
+    a.batchEnd();
+  }
+  uint64_t t1 = nowNs();
+
+  Histogram latency;
+  for (uint64_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      uint64_t s = nowNs();
+      ptrs[i] = a.allocate(size);
+      latency.add(nowNs() - s);
+      *(volatile char *)ptrs[i] = (char)i;
+    }
+    for (size_t i = 0; i < kBatch; ++i) {
+      uint64_t s = nowNs();
+      a.deallocate(ptrs[i], size);
+      latency.add(nowNs() - s);
+    }
+    a.batchEnd();
+  }
+
+  Result r;
+  r.bench = "size_class";
+  r.alloc = A::kName;
+  r.size = size;
+  r.ops = rounds * kBatch;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.latency = &latency;
+  r.rssGrowth = rssDelta(base);
+  emit(r);
+}
+
+//* 多线程扩展性：每个线程各自持有分配器实例(malloc 和 sgi_stl 底层共享)，随机 16~512 字节，
+//* 每个线程都做 iters 次开辟+释放，线程数增加时总吞吐理想情况下线性增长
+template <typename A>
+void scaling(int threads) {
+  std::vector<Histogram> latency(threads);
+  StartGate gate(threads + 1);
+  size_t base = rssBytes();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([t, &latency, &gate] {
+      A a;
+      std::mt19937 rng(t);
+      std::vector<void *> ptrs(kBatch);
+      std::vector<size_t> sizes(kBatch);
+      for (size_t i = 0; i < kBatch; ++i) {
+        sizes[i] = 16 + rng() % 497;
+      }
+      gate.arriveAndWait();
+      uint64_t rounds = (opt.iters + kBatch - 1) / kBatch;
+      for (uint64_t r = 0; r < rounds; ++r) {
+        //* 每 16 轮逐次计时一轮，计时本身不拖慢吞吐
+        bool timed = r % 16 == 0;
+        for (size_t i = 0; i < kBatch; ++i) {
+          uint64_t s = timed ? nowNs() : 0;
+          ptrs[i] = a.allocate(sizes[i]);
+          if (timed) {
+            latency[t].add(nowNs() - s);
+          }
+          *(volatile char *)ptrs[i] = (char)i;
+        }
+        for (size_t i = 0; i < kBatch; ++i) {
+          a.deallocate(ptrs[i], sizes[i]);
+        }
+        a.batchEnd();
+      }
+    });
+  }
+  gate.arriveAndWait();
+  uint64_t t0 = gate.startNs();
+  for (auto &w : workers) {
+    w.join();
+  }
+  uint64_t t1 = nowNs();
+
+  Histogram all;
+  for (auto &h : latency) {
+    all.merge(h);
+  }
+  Result r;
+  r.bench = "scaling";
+  r.alloc = A::kName;
+  r.threads = threads;
+  r.ops = (uint64_t)threads * ((opt.iters + kBatch - 1) / kBatch) * kBatch;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.latency = &all;
+  r.rssGrowth = rssDelta(base);
+  emit(r);
+}
+
+//* 单生产者单消费者的环形队列
+class Ring {
+public:
+  bool push(void *p) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kSize) {
+      return false;
+    }
+    slots_[tail % kSize] = p;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  void *pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    void *p = slots_[head % kSize];
+    head_.store(head + 1, std::memory_order_release);
+    return p;
+  }
+
+private:
+  static const size_t kSize = 4096;
+  void *slots_[kSize];
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+};
+
+//* 跨线程释放：pairs 对生产者/消费者，生产者开辟后经队列交给消费者释放，统计消费者释放的延迟
+//* NgxMemPool 的小块内存不能单独释放，不参与
+template <typename A>
+void producerConsumer(int pairs, size_t size) {
+  std::vector<Ring> rings(pairs);
+  std::vector<Histogram> latency(pairs);
+  StartGate gate(2 * pairs + 1);
+  size_t base = rssBytes();
+  std::vector<std::thread> workers;
+  for (int p = 0; p < pairs; ++p) {
+    workers.emplace_back([p, size, &rings, &gate] {
+      A a;
+      gate.arriveAndWait();
+      for (uint64_t i = 0; i < opt.iters; ++i) {
+        void *obj = a.allocate(size);
+        *(volatile char *)obj = (char)i;
+        while (!rings[p].push(obj)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+    workers.emplace_back([p, size, &rings, &latency, &gate] {
+      A a;
+      gate.arriveAndWait();
+      for (uint64_t i = 0; i < opt.iters; ++i) {
+        void *obj;
+        while ((obj = rings[p].pop()) == nullptr) {
+          std::this_thread::yield();
+        }
+        bool timed = i % 16 == 0;
+        uint64_t s = timed ? nowNs() : 0;
+        a.deallocate(obj, size);
+        if (timed) {
+          latency[p].add(nowNs() - s);
+        }
+      }
+    });
+  }
+  gate.arriveAndWait();
+  uint64_t t0 = gate.startNs();
+  for (auto &w : workers) {
+    w.join();
+  }
+  uint64_t t1 = nowNs();
+
+  Histogram all;
+  for (auto &h : latency) {
+    all.merge(h);
+  }
+  Result r;
+  r.bench = "producer_consumer";
+  r.alloc = A::kName;
+  r.size = size;
+  r.threads = 2 * pairs;
+  r.ops = (uint64_t)pairs * opt.iters;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.latency = &all;
+  r.rssGrowth = rssDelta(base);
+  emit(r);
+}
+
+//* 按请求的生命周期：每个请求开辟 kRequestAllocs 个 16~1024 字节的对象(每 32 个中有一个 8KB 的大块)，
+//* 请求结束时全部释放；NgxMemPool 每个请求创建一个 4KB 的内存池，结束时销毁
+const size_t kRequestAllocs = 64;
+
+std::vector<size_t> requestSizes() {
+  std::mt19937 rng(42);
+  std::vector<size_t> sizes(kRequestAllocs);
+  for (size_t i = 0; i < kRequestAllocs; ++i) {
+    sizes[i] = i % 32 == 31 ? 8192 : 16 + rng() % 1009;
+  }
+  return sizes;
+}
+
+template <typename A>
+void requestCycle() {
+  A a;
+  std::vector<size_t> sizes = requestSizes();
+  std::vector<void *> ptrs(kRequestAllocs);
+  uint64_t requests = opt.iters / kRequestAllocs + 1;
+  size_t base = rssBytes();
+  Histogram latency;
+
+  uint64_t t0 = nowNs();
+  for (uint64_t q = 0; q < requests; ++q) {
+    uint64_t s = nowNs();
+    for (size_t i = 0; i < kRequestAllocs; ++i) {
+      ptrs[i] = a.allocate(sizes[i]);
+      *(volatile char *)ptrs[i] = (char)i;
+    }
+    for (size_t i = 0; i < kRequestAllocs; ++i) {
+      a.deallocate(ptrs[i], sizes[i]);
+    }
+    latency.add(nowNs() - s);
+  }
+  uint64_t t1 = nowNs();
+
+  Result r;
+  r.bench = "request";
+  r.alloc = A::kName;
+  r.ops = requests;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.latency = &latency;
+  r.rssGrowth = rssDelta(base);
+  emit(r);
+}
+
+void requestCycleNgx() {
+  std::vector<size_t> sizes = requestSizes();
+  uint64_t requests = opt.iters / kRequestAllocs + 1;
+  size_t base = rssBytes();
+  Histogram latency;
+
+  uint64_t t0 = nowNs();
+  for (uint64_t q = 0; q < requests; ++q) {
+    uint64_t s = nowNs();
+    {
+      NgxMemPool pool(4096);
+      for (size_t i = 0; i < kRequestAllocs; ++i) {
+        *(volatile char *)pool.ngxPalloc(sizes[i]) = (char)i;
+      }
+    }
+    latency.add(nowNs() - s);
+  }
+  uint64_t t1 = nowNs();
+
+  Result r;
+  r.bench = "request";
+  r.alloc = NgxAlloc::kName;
+  r.ops = requests;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.latency = &latency;
+  r.rssGrowth = rssDelta(base);
+  emit(r);
+}
+
+//* 碎片率：维持约 64MB、大小按对数均匀分布在 16B~4KB 的存活对象，随机替换 iters 次后
+//* 比较 RSS 增量与存活对象的字节数，frag_ratio 越接近 1 越好
+template <typename A>
+void fragmentation() {
+  const size_t kSlots = 32768;
+  A a;
+  std::mt19937 rng(7);
+  std::vector<void *> ptrs(kSlots);
+  std::vector<size_t> sizes(kSlots);
+  size_t live = 0;
+  size_t base = rssBytes();
+  auto randomSize = [&rng] { return (size_t)16 << (rng() % 9); };
+  auto fill = [&](size_t i) {
+    sizes[i] = randomSize() + rng() % 16;
+    ptrs[i] = a.allocate(sizes[i]);
+    memset(ptrs[i], 1, sizes[i]);
+    live += sizes[i];
+  };
+
+  uint64_t t0 = nowNs();
+  for (size_t i = 0; i < kSlots; ++i) {
+    fill(i);
+  }
+  for (uint64_t n = 0; n < opt.iters; ++n) {
+    size_t i = rng() % kSlots;
+    a.deallocate(ptrs[i], sizes[i]);
+    live -= sizes[i];
+    fill(i);
+  }
+  uint64_t t1 = nowNs();
+
+  Result r;
+  r.bench = "fragmentation";
+  r.alloc = A::kName;
+  r.ops = opt.iters;
+  r.seconds = (double)(t1 - t0) / 1e9;
+  r.rssGrowth = rssDelta(base);
+  r.liveBytes = live;
+  emit(r);
+  for (size_t i = 0; i < kSlots; ++i) {
+    a.deallocate(ptrs[i], sizes[i]);
+  }
+}
+
+std::vector<int> threadCounts() {
+  std::vector<int> counts;
+  for (int t = 1; t < opt.maxThreads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(opt.maxThreads);
+  return counts;
+}
+
+} //* namespace
+
+int main(int argc, char **argv) {
+  opt.maxThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+      opt.iters = strtoull(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      opt.maxThreads = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+      opt.filter = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--iters N] [--threads N] [--bench name]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (opt.iters == 0) {
+    opt.iters = 1;
+  }
+
+  const char *preload = getenv("LD_PRELOAD");
+  printf("{\"commit\":\"%s\",\"bench\":\"meta\",\"malloc_impl\":\"%s\",\"cpus\":%u,\"iters\":%llu,"
+         "\"max_threads\":%d,\"sgi_config\":\"per_cpu=%d,thread_cache=%d,lock_free=%d,remote_free=%d\","
+         "\"ngx_alignment\":%zu}\n",
+         BENCH_COMMIT, preload ? preload : "glibc", std::thread::hardware_concurrency(),
+         (unsigned long long)opt.iters, opt.maxThreads, SGI_STL_PER_CPU, SGI_STL_THREAD_CACHE,
+         SGI_STL_LOCK_FREE, SGI_STL_REMOTE_FREE, (size_t)NGX_ALIGNMENT);
+
+  for (size_t size : {16, 64, 256, 1024, 4096, 16384}) {
+    isolated("size_class", [size] { sizeClass<MallocAlloc>(size); });
+    isolated("size_class", [size] { sizeClass<SgiAlloc>(size); });
+    isolated("size_class", [size] { sizeClass<NgxAlloc>(size); });
+  }
+
+  for (int t : threadCounts()) {
+    isolated("scaling", [t] { scaling<MallocAlloc>(t); });
+    isolated("scaling", [t] { scaling<SgiAlloc>(t); });
+    isolated("scaling", [t] { scaling<NgxAlloc>(t); });
+  }
+
+  std::vector<int> pairs = {1};
+  if (opt.maxThreads / 2 > 1) {
+    pairs.push_back(opt.maxThreads / 2);
+  }
+  for (int p : pairs) {
+    isolated("producer_consumer", [p] { producerConsumer<MallocAlloc>(p, 64); });
+    isolated("producer_consumer", [p] { producerConsumer<SgiAlloc>(p, 64); });
+  }
+
+  isolated("request", [] { requestCycle<MallocAlloc>(); });
+  isolated("request", [] { requestCycle<SgiAlloc>(); });
+  isolated("request", [] { requestCycleNgx(); });
+
+  isolated("fragmentation", [] { fragmentation<MallocAlloc>(); });
+  isolated("fragmentation", [] { fragmentation<SgiAlloc>(); });
+  return 0;
+}
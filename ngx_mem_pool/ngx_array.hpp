@@ -0,0 +1,73 @@
+#ifndef NGX_ARRAY_H
+#define NGX_ARRAY_H
+
+#include <string.h>
+#include <type_traits>
+#include "ngx_mem_pool.hpp"
+
+//* 内存池中的动态数组，对应 nginx 的 ngx_array_t
+//* 元素连续存放；扩容时如果数组恰好位于所在小块内存块的末尾且剩余空间足够，ngxPextend 就地扩大，不拷贝元素
+//* ngxPextend 失败时(包括数组在大块内存中)按两倍开辟新空间并拷贝全部元素，之前取得的元素地址随之失效；
+//* 旧空间是大块内存(ngxIsLarge)时立即交给 ngxPfree，小块内存随内存池一起释放
+//* 元素不会被析构，要求 T 可以平凡拷贝；数组对象本身也是平凡析构的，可以用 ngxCreate 放在内存池中
+template <typename T, typename Pool = NgxMemPool>
+class NgxArray {
+  static_assert(std::is_trivially_copyable<T>::value, "NgxArray elements are copied with memcpy");
+
+public:
+  //* n 为初始容量，第一次 ngxPush 时才开辟
+  NgxArray(Pool &pool, size_t n) : elts_(nullptr), nelts_(0), nalloc_(n ? n : 1), pool_(&pool) {}
+
+  //* 在末尾追加一个元素，返回它的地址，开辟失败返回 nullptr
+  T *ngxPush() { return ngxPushN(1); }
+
+  //* 在末尾追加 n 个连续的元素，返回第一个的地址，开辟失败返回 nullptr
+  T *ngxPushN(size_t n) {
+    if (elts_ == nullptr) {
+      size_t cap = n > nalloc_ ? n : nalloc_;
+      elts_ = (T *)pool_->ngxPallocAligned(cap * sizeof(T), alignof(T));
+      if (elts_ == nullptr) {
+        return nullptr;
+      }
+      nalloc_ = cap;
+    } else if (nelts_ + n > nalloc_) {
+      size_t cap = 2 * (n > nalloc_ ? n : nalloc_);
+      //* 数组位于内存块末尾，就地扩大到 cap
+      if (pool_->ngxPextend(elts_, nalloc_ * sizeof(T), (cap - nalloc_) * sizeof(T))) {
+        nalloc_ = cap;
+      } else {
+        T *elts = (T *)pool_->ngxPallocAligned(cap * sizeof(T), alignof(T));
+        if (elts == nullptr) {
+          return nullptr;
+        }
+        memcpy((void *)elts, elts_, nelts_ * sizeof(T));
+        if (pool_->ngxIsLarge(nalloc_ * sizeof(T))) {
+          pool_->ngxPfree(elts_);
+        }
+        elts_ = elts;
+        nalloc_ = cap;
+      }
+    }
+    T *elt = elts_ + nelts_;
+    nelts_ += n;
+    return elt;
+  }
+
+  size_t size() const { return nelts_; }
+  size_t capacity() const { return elts_ ? nalloc_ : 0; }
+  bool empty() const { return nelts_ == 0; }
+  T &operator[](size_t i) { return elts_[i]; }
+  const T &operator[](size_t i) const { return elts_[i]; }
+  T *begin() { return elts_; }
+  T *end() { return elts_ + nelts_; }
+  const T *begin() const { return elts_; }
+  const T *end() const { return elts_ + nelts_; }
+
+private:
+  T                 *elts_;      //* 元素起始地址
+  size_t            nelts_;      //* 已使用的元素个数
+  size_t            nalloc_;     //* 容量
+  Pool              *pool_;
+};
+
+#endif
@@ -0,0 +1,161 @@
+#include "ngx_buf.hpp"
+
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+off_t ngxChainSize(const NgxChain *in) {
+  off_t size = 0;
+  for (; in; in = in->next_) {
+    size += ngxBufSize(in->buf_);
+  }
+  return size;
+}
+
+NgxChain *ngxChainUpdateSent(NgxChain *in, size_t sent) {
+  for (; in && sent; in = in->next_) {
+    NgxBuf *b = in->buf_;
+    size_t size = (size_t)ngxBufSize(b);
+    //* 这个缓冲区只处理了一部分，停在这里
+    if (sent < size) {
+      if (b->inFile_) {
+        b->filePos_ += (off_t)sent;
+      } else {
+        b->pos_ += sent;
+      }
+      break;
+    }
+    sent -= size;
+    if (b->inFile_) {
+      b->filePos_ = b->fileLast_;
+    } else {
+      b->pos_ = b->last_;
+    }
+  }
+  //* 跳过已经处理完的空缓冲区
+  while (in && ngxBufSize(in->buf_) == 0) {
+    in = in->next_;
+  }
+  return in;
+}
+
+ssize_t ngxReadvChain(int fd, NgxChain *in, size_t limit) {
+  struct iovec iovs[NGX_IOVS_PREALLOCATE];
+  int niov = 0;
+  size_t total = 0;
+
+  //* 收集各内存缓冲区的空闲空间，物理上相邻的空闲空间合并为一个 iovec
+  for (NgxChain *cl = in; cl && (!limit || total < limit); cl = cl->next_) {
+    NgxBuf *b = cl->buf_;
+    if (b->inFile_ || b->last_ == b->end_) {
+      continue;
+    }
+    size_t size = (size_t)(b->end_ - b->last_);
+    if (limit && size > limit - total) {
+      size = limit - total;
+    }
+    if (niov > 0 && (u_char *)iovs[niov - 1].iov_base + iovs[niov - 1].iov_len == b->last_) {
+      iovs[niov - 1].iov_len += size;
+    } else if (niov < NGX_IOVS_PREALLOCATE) {
+      iovs[niov].iov_base = b->last_;
+      iovs[niov].iov_len = size;
+      ++niov;
+    } else {
+      break;
+    }
+    total += size;
+  }
+  if (niov == 0) {
+    return 0;
+  }
+
+  ssize_t n;
+  do {
+    n = readv(fd, iovs, niov);
+  } while (n == -1 && errno == EINTR);
+  if (n <= 0) {
+    return n;
+  }
+
+  //* 数据已经直接落在各缓冲区中，按读到的字节数依次推进 last_
+  size_t left = (size_t)n;
+  for (NgxChain *cl = in; cl && left; cl = cl->next_) {
+    NgxBuf *b = cl->buf_;
+    if (b->inFile_) {
+      continue;
+    }
+    size_t size = (size_t)(b->end_ - b->last_);
+    if (size > left) {
+      size = left;
+    }
+    b->last_ += size;
+    left -= size;
+  }
+  return n;
+}
+
+NgxChain *ngxWriteChain(int fd, NgxChain *in, size_t limit) {
+  struct iovec iovs[NGX_IOVS_PREALLOCATE];
+  size_t sent = 0;
+
+  in = ngxChainUpdateSent(in, 0);
+  while (in) {
+    size_t budget = limit ? limit - sent : (size_t)-1;
+    size_t want = 0;
+    ssize_t n;
+
+    if (in->buf_->inFile_) {
+      //* 文件缓冲区：sendfile 在内核中直接从文件拷贝到 fd
+      NgxBuf *b = in->buf_;
+      off_t offset = b->filePos_;
+      want = (size_t)(b->fileLast_ - b->filePos_);
+      if (want > budget) {
+        want = budget;
+      }
+      n = sendfile(fd, b->fd_, &offset, want);
+    } else {
+      //* 连续的内存缓冲区：收集到遇见文件缓冲区为止，一次 writev 写出
+      int niov = 0;
+      for (NgxChain *cl = in; cl && !cl->buf_->inFile_ && want < budget; cl = cl->next_) {
+        NgxBuf *b = cl->buf_;
+        size_t size = (size_t)(b->last_ - b->pos_);
+        if (size == 0) {
+          continue;
+        }
+        if (size > budget - want) {
+          size = budget - want;
+        }
+        if (niov > 0 && (u_char *)iovs[niov - 1].iov_base + iovs[niov - 1].iov_len == b->pos_) {
+          iovs[niov - 1].iov_len += size;
+        } else if (niov < NGX_IOVS_PREALLOCATE) {
+          iovs[niov].iov_base = b->pos_;
+          iovs[niov].iov_len = size;
+          ++niov;
+        } else {
+          break;
+        }
+        want += size;
+      }
+      n = writev(fd, iovs, niov);
+    }
+
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      //* 写满了，剩余部分留给下一次
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return in;
+      }
+      return NGX_CHAIN_ERROR;
+    }
+
+    sent += (size_t)n;
+    in = ngxChainUpdateSent(in, (size_t)n);
+    //* 只写出了一部分说明 fd 已写满；或者已写够 limit
+    if ((size_t)n < want || (limit && sent >= limit)) {
+      return in;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,111 @@
+#ifndef NGX_BUF_H
+#define NGX_BUF_H
+
+#include <sys/types.h>
+#include "ngx_mem_pool.hpp"
+
+//* 缓冲区，对应 nginx 的 ngx_buf_t，缓冲区头部和内存都在内存池中开辟
+//* 内存缓冲区：[pos_, last_) 是待处理(待发送)的数据，[last_, end_) 是还可以读入数据的空闲空间
+//* 文件缓冲区：数据是 fd_ 中的 [filePos_, fileLast_) 一段，发送时走 sendfile，不经过用户态内存
+struct NgxBuf {
+  u_char            *pos_;       //* 待处理数据的起始地址，读游标
+  u_char            *last_;      //* 已有数据的末尾地址，写游标
+  u_char            *start_;     //* 缓冲区内存的起始地址
+  u_char            *end_;       //* 缓冲区内存的末尾地址
+  off_t             filePos_;    //* 文件缓冲区待发送部分的起始偏移
+  off_t             fileLast_;   //* 文件缓冲区待发送部分的末尾偏移
+  int               fd_;         //* 文件缓冲区的文件描述符
+  unsigned          temporary_:1;  //* 持有 [start_, end_) 这段内存，消费完后可以回收复用
+  unsigned          inFile_:1;     //* 文件缓冲区
+};
+
+//* 缓冲区链表，对应 nginx 的 ngx_chain_t
+struct NgxChain {
+  NgxBuf            *buf_;
+  NgxChain          *next_;
+};
+
+//* ngxWriteChain 出错时的返回值
+#define NGX_CHAIN_ERROR ((NgxChain *)-1)
+
+//* 一次 readv/writev 最多携带的缓冲区个数
+#ifndef NGX_IOVS_PREALLOCATE
+#define NGX_IOVS_PREALLOCATE 64
+#endif
+
+//* 缓冲区中尚未处理的字节数
+inline off_t ngxBufSize(const NgxBuf *b) {
+  return b->inFile_ ? b->fileLast_ - b->filePos_ : (off_t)(b->last_ - b->pos_);
+}
+
+//* 链表中所有缓冲区尚未处理的字节数
+off_t ngxChainSize(const NgxChain *in);
+
+//* 按已处理的 sent 字节推进各缓冲区的 pos_ 或 filePos_，返回第一个仍有数据的节点，全部处理完返回 nullptr
+NgxChain *ngxChainUpdateSent(NgxChain *in, size_t sent);
+
+//* 用一次 readv 把 fd 中的数据直接读入 in 中各内存缓冲区的空闲空间 [last_, end_)，推进 last_
+//* limit 为 0 时不限制本次读入的字节数
+//* 返回读到的字节数；0 表示对端已关闭或没有空闲空间；-1 表示出错，errno 为 EAGAIN 时表示暂无数据
+ssize_t ngxReadvChain(int fd, NgxChain *in, size_t limit);
+
+//* 把 in 中的数据写到 fd：相邻的内存缓冲区合并为一次 writev，文件缓冲区用 sendfile
+//* 写满(EAGAIN)或写够 limit 字节时停止，limit 为 0 时不限制
+//* 返回第一个未写完的节点，全部写完返回 nullptr，出错返回 NGX_CHAIN_ERROR
+NgxChain *ngxWriteChain(int fd, NgxChain *in, size_t limit);
+
+//* 在 cl 的内存缓冲区 pos_ 之后 n 字节处拆分，不拷贝数据
+//* 后一半放入新缓冲区并插在 cl 之后，两者各自持有拆分点两侧的内存，可以分别回收
+//* n 超过缓冲区中的数据或缓冲区是文件缓冲区时返回 nullptr
+template <typename Pool>
+NgxChain *ngxSplitBuf(Pool &pool, NgxChain *cl, size_t n) {
+  NgxBuf *b = cl->buf_;
+  if (b->inFile_ || n > (size_t)(b->last_ - b->pos_)) {
+    return nullptr;
+  }
+  NgxChain *tail = pool.ngxAllocChainLink();
+  if (tail == nullptr) {
+    return nullptr;
+  }
+  NgxBuf *t = (NgxBuf *)pool.ngxPcalloc(sizeof(NgxBuf));
+  if (t == nullptr) {
+    pool.ngxFreeChain(tail);
+    return nullptr;
+  }
+  u_char *split = b->pos_ + n;
+  t->start_ = split;
+  t->pos_ = split;
+  t->last_ = b->last_;
+  t->end_ = b->end_;
+  t->temporary_ = b->temporary_;
+  b->last_ = split;
+  b->end_ = split;
+
+  tail->buf_ = t;
+  tail->next_ = cl->next_;
+  cl->next_ = tail;
+  return tail;
+}
+
+//* 合并链表中内存首尾相接的相邻缓冲区，不拷贝数据，是 ngxSplitBuf 的逆操作
+//* 前一个缓冲区已写满且后一个缓冲区尚未被消费时才能合并，被合并的节点交还内存池
+template <typename Pool>
+void ngxChainCoalesce(Pool &pool, NgxChain *in) {
+  NgxChain *cl = in;
+  while (cl && cl->next_) {
+    NgxBuf *a = cl->buf_;
+    NgxBuf *b = cl->next_->buf_;
+    if (!a->inFile_ && !b->inFile_ && a->temporary_ == b->temporary_ &&
+        a->last_ == a->end_ && a->end_ == b->start_ && b->pos_ == b->start_) {
+      NgxChain *next = cl->next_;
+      a->last_ = b->last_;
+      a->end_ = b->end_;
+      cl->next_ = next->next_;
+      pool.ngxFreeChain(next);
+      continue;
+    }
+    cl = cl->next_;
+  }
+}
+
+#endif
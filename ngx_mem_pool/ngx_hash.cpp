@@ -0,0 +1,205 @@
+#include "ngx_hash.hpp"
+
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+//* 一个元素占用的字节数，按指针对齐，下一个元素的 value_ 才能对齐
+static size_t ngxHashEltSize(size_t len) {
+  return ngxAlign(offsetof(NgxHashElt, name_) + len, sizeof(void *));
+}
+
+ngx_uint ngxHashKey(const u_char *data, size_t len) {
+  ngx_uint key = 0;
+  for (size_t i = 0; i < len; ++i) {
+    key = ngxHash(key, data[i]);
+  }
+  return key;
+}
+
+ngx_uint ngxHashKeyLc(const u_char *data, size_t len) {
+  ngx_uint key = 0;
+  for (size_t i = 0; i < len; ++i) {
+    key = ngxHash(key, tolower(data[i]));
+  }
+  return key;
+}
+
+ngx_uint ngxHashStrlow(u_char *dst, const u_char *src, size_t n) {
+  ngx_uint key = 0;
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = (u_char)tolower(src[i]);
+    key = ngxHash(key, dst[i]);
+  }
+  return key;
+}
+
+template <typename Pool>
+bool NgxHash::ngxHashInit(Pool &pool, const NgxHashKey *keys, size_t n, size_t maxSize,
+                          size_t bucketSize) {
+  buckets_ = nullptr;
+  size_ = 0;
+  if (n == 0) {
+    return true;
+  }
+  if (maxSize == 0) {
+    return false;
+  }
+
+  //* 每个桶末尾还要放一个空指针作为结束标记
+  std::vector<ngx_uint> hashes(n);
+  for (size_t i = 0; i < n; ++i) {
+    if (keys[i].len_ > 65535 || ngxHashEltSize(keys[i].len_) + sizeof(void *) > bucketSize) {
+      return false;
+    }
+    hashes[i] = ngxHashKeyLc(keys[i].name_, keys[i].len_);
+  }
+
+  //* 从估计的下限开始找最小的桶数，使每个桶的元素都放得进 bucketSize
+  std::vector<size_t> test(maxSize);
+  size_t start = n / (bucketSize / (2 * sizeof(void *)));
+  size_t size;
+  for (size = start ? start : 1; size <= maxSize; ++size) {
+    bool fit = true;
+    std::fill(test.begin(), test.begin() + size, 0);
+    for (size_t i = 0; i < n; ++i) {
+      size_t k = hashes[i] % size;
+      test[k] += ngxHashEltSize(keys[i].len_);
+      if (test[k] + sizeof(void *) > bucketSize) {
+        fit = false;
+        break;
+      }
+    }
+    if (fit) {
+      break;
+    }
+  }
+  if (size > maxSize) {
+    return false;
+  }
+
+  //* 每个非空桶从缓存行边界开始，所有桶的元素开辟在一整块内存中
+  size_t total = 0;
+  for (size_t k = 0; k < size; ++k) {
+    if (test[k]) {
+      total += ngxAlign(test[k] + sizeof(void *), (size_t)NGX_CACHELINE_SIZE);
+    }
+  }
+  NgxHashElt **buckets = (NgxHashElt **)pool.ngxPcalloc(size * sizeof(NgxHashElt *));
+  u_char *elts = (u_char *)pool.ngxPallocAligned(total, NGX_CACHELINE_SIZE);
+  if (buckets == nullptr || elts == nullptr) {
+    return false;
+  }
+  for (size_t k = 0; k < size; ++k) {
+    if (test[k]) {
+      buckets[k] = (NgxHashElt *)elts;
+      elts += ngxAlign(test[k] + sizeof(void *), (size_t)NGX_CACHELINE_SIZE);
+    }
+    test[k] = 0;
+  }
+
+  //* 依次填入元素，test 复用为各桶的写入偏移
+  for (size_t i = 0; i < n; ++i) {
+    size_t k = hashes[i] % size;
+    NgxHashElt *elt = (NgxHashElt *)((u_char *)buckets[k] + test[k]);
+    elt->value_ = keys[i].value_;
+    elt->len_ = (unsigned short)keys[i].len_;
+    for (size_t j = 0; j < keys[i].len_; ++j) {
+      elt->name_[j] = (u_char)tolower(keys[i].name_[j]);
+    }
+    test[k] += ngxHashEltSize(keys[i].len_);
+  }
+  for (size_t k = 0; k < size; ++k) {
+    if (buckets[k]) {
+      *(void **)((u_char *)buckets[k] + test[k]) = nullptr;
+    }
+  }
+
+  buckets_ = buckets;
+  size_ = size;
+  return true;
+}
+
+void *NgxHash::ngxHashFind(ngx_uint key, const u_char *name, size_t len) const {
+  if (size_ == 0) {
+    return nullptr;
+  }
+  NgxHashElt *elt = buckets_[key % size_];
+  if (elt == nullptr) {
+    return nullptr;
+  }
+  while (elt->value_) {
+    if (len == elt->len_ && memcmp(name, elt->name_, len) == 0) {
+      return elt->value_;
+    }
+    elt = (NgxHashElt *)((u_char *)elt + ngxHashEltSize(elt->len_));
+  }
+  return nullptr;
+}
+
+template <typename Pool>
+bool NgxHashCombined::ngxHashInit(Pool &pool, const NgxHashKey *keys, size_t n, size_t maxSize,
+                                  size_t bucketSize) {
+  //* 按键的形式分到三张表，去掉通配符后的键直接指向原字符串，不拷贝
+  std::vector<NgxHashKey> exact, head, tail;
+  for (size_t i = 0; i < n; ++i) {
+    NgxHashKey k = keys[i];
+    if (k.len_ > 2 && k.name_[0] == '*' && k.name_[1] == '.') {
+      k.name_ += 2;
+      k.len_ -= 2;
+      head.push_back(k);
+    } else if (k.len_ > 1 && k.name_[0] == '.') {
+      k.name_ += 1;
+      k.len_ -= 1;
+      head.push_back(k);
+      exact.push_back(k);
+    } else if (k.len_ > 2 && k.name_[k.len_ - 1] == '*' && k.name_[k.len_ - 2] == '.') {
+      k.len_ -= 2;
+      tail.push_back(k);
+    } else {
+      exact.push_back(k);
+    }
+  }
+  return exact_.ngxHashInit(pool, exact.data(), exact.size(), maxSize, bucketSize) &&
+         wcHead_.ngxHashInit(pool, head.data(), head.size(), maxSize, bucketSize) &&
+         wcTail_.ngxHashInit(pool, tail.data(), tail.size(), maxSize, bucketSize);
+}
+
+void *NgxHashCombined::ngxHashFind(ngx_uint key, const u_char *name, size_t len) const {
+  void *value = exact_.ngxHashFind(key, name, len);
+  if (value) {
+    return value;
+  }
+
+  //* "a.b.example.com" 依次查找 "b.example.com"、"example.com"、"com"，越长越具体
+  if (wcHead_.size()) {
+    for (size_t i = 0; i < len; ++i) {
+      if (name[i] == '.') {
+        value = wcHead_.ngxHashFind(ngxHashKey(name + i + 1, len - i - 1), name + i + 1, len - i - 1);
+        if (value) {
+          return value;
+        }
+      }
+    }
+  }
+
+  //* "www.example.com" 依次查找 "www.example"、"www"
+  if (wcTail_.size()) {
+    for (size_t i = len; i-- > 0;) {
+      if (name[i] == '.') {
+        value = wcTail_.ngxHashFind(ngxHashKey(name, i), name, i);
+        if (value) {
+          return value;
+        }
+      }
+    }
+  }
+  return nullptr;
+}
+
+template bool NgxHash::ngxHashInit(NgxMemPool &, const NgxHashKey *, size_t, size_t, size_t);
+template bool NgxHash::ngxHashInit(NgxConcurrentMemPool &, const NgxHashKey *, size_t, size_t, size_t);
+template bool NgxHashCombined::ngxHashInit(NgxMemPool &, const NgxHashKey *, size_t, size_t, size_t);
+template bool NgxHashCombined::ngxHashInit(NgxConcurrentMemPool &, const NgxHashKey *, size_t, size_t, size_t);
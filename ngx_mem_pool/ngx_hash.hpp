@@ -0,0 +1,80 @@
+#ifndef NGX_HASH_H
+#define NGX_HASH_H
+
+#include "ngx_mem_pool.hpp"
+
+#ifndef NGX_CACHELINE_SIZE
+#define NGX_CACHELINE_SIZE 64  //* 桶按缓存行对齐，一个桶的元素尽量落在同一个缓存行中
+#endif
+
+//* 累加一个字符的散列值，与 nginx 的 ngx_hash 相同
+#define ngxHash(key, c) ((ngx_uint)(key) * 31 + (c))
+
+//* 字符串的散列值
+ngx_uint ngxHashKey(const u_char *data, size_t len);
+//* 转成小写后的散列值
+ngx_uint ngxHashKeyLc(const u_char *data, size_t len);
+//* 把 src 转成小写拷贝到 dst，同时返回散列值；查找前用它处理大小写不敏感的键(例如 HTTP 头)
+ngx_uint ngxHashStrlow(u_char *dst, const u_char *src, size_t n);
+
+//* 建表时的一个键值对，value_ 不能为空
+struct NgxHashKey {
+  const u_char      *name_;
+  size_t            len_;
+  void              *value_;
+};
+
+//* 散列表中的一个元素，同一个桶的元素紧挨着存放，以 value_ 为空的一个指针结束
+struct NgxHashElt {
+  void              *value_;
+  unsigned short    len_;
+  u_char            name_[1];    //* 小写的键，实际长度为 len_
+};
+
+//* 一次建成、只读查找的散列表，对应 nginx 的 ngx_hash_t
+//* 建表时从小到大尝试桶数，取能让每个桶都放进 bucketSize 字节的最小值，整张表占用的缓存行最少；
+//* 所有桶的元素开辟在一整块按缓存行对齐的内存中，查找时顺序比较，没有链表指针的跳转
+//* 键在建表时转成小写，查找时传入的 name 须已是小写；重复的键只有第一个生效
+class NgxHash {
+public:
+  NgxHash() : buckets_(nullptr), size_(0) {}
+
+  //* 用 n 个键值对建表，桶数不超过 maxSize；单个键放不进 bucketSize 或找不到合适的桶数时返回 false
+  template <typename Pool>
+  bool ngxHashInit(Pool &pool, const NgxHashKey *keys, size_t n, size_t maxSize,
+                   size_t bucketSize = NGX_CACHELINE_SIZE);
+
+  //* key 为 ngxHashKey(name, len)，找不到返回 nullptr
+  void *ngxHashFind(ngx_uint key, const u_char *name, size_t len) const;
+
+  size_t size() const { return size_; }
+
+private:
+  NgxHashElt        **buckets_;  //* 每个桶第一个元素的地址，空桶为 nullptr
+  size_t            size_;       //* 桶数
+};
+
+//* 带通配符的散列表，对应 nginx 的 ngx_hash_combined_t
+//* 键的形式：
+//*   "www.example.com"   精确匹配
+//*   "*.example.com"     匹配 example.com 的所有子域名，不含 example.com 本身
+//*   ".example.com"      同时匹配 example.com 和它的所有子域名
+//*   "www.example.*"     匹配以 www.example. 开头的名字
+//* 查找顺序：精确匹配，然后前置通配符从最长的后缀开始，最后后置通配符从最长的前缀开始
+//* 通配符部分按 "." 分段后在各自的 NgxHash 中查找，不另建嵌套的表
+class NgxHashCombined {
+public:
+  template <typename Pool>
+  bool ngxHashInit(Pool &pool, const NgxHashKey *keys, size_t n, size_t maxSize,
+                   size_t bucketSize = NGX_CACHELINE_SIZE);
+
+  //* name 须已是小写，key 为 ngxHashKey(name, len)
+  void *ngxHashFind(ngx_uint key, const u_char *name, size_t len) const;
+
+private:
+  NgxHash           exact_;      //* 精确匹配的键
+  NgxHash           wcHead_;     //* 前置通配符去掉 "*." 或 "." 后的后缀
+  NgxHash           wcTail_;     //* 后置通配符去掉 ".*" 后的前缀
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef NGX_LIST_H
+#define NGX_LIST_H
+
+#include <type_traits>
+#include "ngx_mem_pool.hpp"
+
+//* 内存池中的分段链表，对应 nginx 的 ngx_list_t
+//* 每段是容量为 n 的连续数组，写满后再开辟一段接在末尾，已有元素从不移动，取得的地址一直有效
+//* 元素不会被析构，要求 T 平凡析构；链表对象本身也是平凡析构的
+template <typename T, typename Pool = NgxMemPool>
+class NgxList {
+  static_assert(std::is_trivially_destructible<T>::value, "NgxList elements are never destroyed");
+
+  struct Part {
+    T               *elts_;      //* 本段的元素
+    size_t          nelts_;      //* 本段已使用的元素个数
+    Part            *next_;
+  };
+
+public:
+  //* n 为每段的容量，第一次 ngxPush 时才开辟
+  NgxList(Pool &pool, size_t n) : last_(&part_), nalloc_(n ? n : 1), pool_(&pool) {
+    part_.elts_ = nullptr;
+    part_.nelts_ = 0;
+    part_.next_ = nullptr;
+  }
+
+  NgxList(const NgxList &) = delete;
+  NgxList &operator=(const NgxList &) = delete;
+
+  //* 在末尾追加一个元素，返回它的地址(未初始化)，开辟失败返回 nullptr
+  T *ngxPush() {
+    Part *last = last_;
+    if (last->elts_ == nullptr) {
+      last->elts_ = (T *)pool_->ngxPallocAligned(nalloc_ * sizeof(T), alignof(T));
+      if (last->elts_ == nullptr) {
+        return nullptr;
+      }
+    } else if (last->nelts_ == nalloc_) {
+      //* 本段已满，段头和元素一起开辟一段新的
+      Part *part = (Part *)pool_->ngxPalloc(sizeof(Part));
+      if (part == nullptr) {
+        return nullptr;
+      }
+      part->elts_ = (T *)pool_->ngxPallocAligned(nalloc_ * sizeof(T), alignof(T));
+      if (part->elts_ == nullptr) {
+        return nullptr;
+      }
+      part->nelts_ = 0;
+      part->next_ = nullptr;
+      last->next_ = part;
+      last_ = part;
+      last = part;
+    }
+    return last->elts_ + last->nelts_++;
+  }
+
+  //* 顺序遍历所有段中的元素
+  class Iterator {
+  public:
+    Iterator(const Part *part, size_t i) : part_(part), i_(i) { skip(); }
+    T &operator*() const { return part_->elts_[i_]; }
+    T *operator->() const { return part_->elts_ + i_; }
+    Iterator &operator++() {
+      ++i_;
+      skip();
+      return *this;
+    }
+    bool operator==(const Iterator &other) const { return part_ == other.part_ && i_ == other.i_; }
+    bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+  private:
+    //* 当前段走完后转到下一段
+    void skip() {
+      while (part_ && i_ >= part_->nelts_) {
+        part_ = part_->next_;
+        i_ = 0;
+      }
+    }
+
+    const Part      *part_;
+    size_t          i_;
+  };
+
+  Iterator begin() const { return Iterator(&part_, 0); }
+  Iterator end() const { return Iterator(nullptr, 0); }
+
+private:
+  Part              part_;       //* 第一段，与链表对象放在一起
+  Part              *last_;      //* 最后一段，新元素追加到这里
+  size_t            nalloc_;     //* 每段的容量
+  Pool              *pool_;
+};
+
+#endif
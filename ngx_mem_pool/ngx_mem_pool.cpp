@@ -1,10 +1,18 @@
 #include "ngx_mem_pool.hpp"
+#include "ngx_buf.hpp"
 
-NgxMemPool::NgxMemPool(size_t size) {
-  pool_ = (NgxPool *)malloc(size);
+#include <stdio.h>
+
+template <typename ThreadPolicy>
+NgxBasicMemPool<ThreadPolicy>::NgxBasicMemPool(size_t size, PageSource *source) : source_(source) {
+  //* 按内存来源的粒度上调内存块大小，mmap、大页来源多出的部分同样可以分配
+  size = ngxAlign(size, source_->granularity());
+  pool_ = (NgxPool *)NgxBlockCache::instance().get(source_, size);
   if (pool_ == nullptr) {
     return;
   }
+  blockSize_ = size;
+  maxBlockSize_ = size;
 
   pool_->d_.last_ = (u_char *)pool_ + sizeof(NgxPool);  //* 内存池可用部分起始地址
   pool_->d_.end_ = (u_char *)pool_ + size;              //* 内存池可用部分末尾地址
@@ -17,34 +25,35 @@ NgxMemPool::NgxMemPool(size_t size) {
 
   pool_->current_ = pool_;
   pool_->large_ = nullptr;
+  pool_->largeFree_ = nullptr;
   pool_->cleanup_ = nullptr;
+  pool_->chain_ = nullptr;
+  pool_->freeBufs_ = nullptr;
 }
 
-NgxMemPool::~NgxMemPool() {
+template <typename ThreadPolicy>
+NgxBasicMemPool<ThreadPolicy>::~NgxBasicMemPool() {
   NgxPool *p, *n;
   NgxPoolLarge *l;
-  NgxPoolCleanup *c;
 
   //* 1. 第一步，释放在大块内存的对象中申请的外部资源
   //* 大块内存中的对象可能会占用外部资源，比如某个对象存储了一个指针，这个指针通过 malloc 开辟了
   //* 一块内存或者打开了某个资源，那么在释放内存池中的资源之前，应该将外部资源释放掉，类似 C++ 中的析构函数，
   //* 应该执行那个释放外部资源的函数(通过用户设置的回调函数 cleanup->handler 实现)
-  for (c = pool_->cleanup_; c; c = c->next_) {
-    if (c->handler_) {
-      c->handler_(c->data_);
-    }
-  }
+  runCleanups();
 
-  //* 2. 第二步，释放大块内存
+  //* 2. 第二步，释放大块内存，包括尺寸桶缓存中的
   for (l = pool_->large_; l; l = l->next_) {
     if (l->alloc_) {
-      free(l->alloc_);
+      l->source_->deallocate(l->start_, l->size_);
     }
   }
+  largeCacheShrink(0);
 
   //* 3. 第三步，清理小块内存 小块内存中存储了很多与大块内存相关的头信息，所以要最后清理
+  //* 内存块还给进程级的块缓存，下一个同样大小的内存池直接复用
   for (p = pool_, n = pool_->d_.next_; /* void */; p = n, n = n->d_.next_) {
-    free(p);
+    NgxBlockCache::instance().put(source_, p, (size_t)(p->d_.end_ - (u_char *)p));
     if (n == nullptr) {
       break;
     }
@@ -73,23 +82,28 @@ NgxMemPool::~NgxMemPool() {
 // }
 
 //* 从内存池申请大小为 size 字节的内存，考虑内存字节对齐
-void *NgxMemPool::ngxPalloc(size_t size) {
-  if (size <= pool_->max_) {
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPalloc(size_t size) {
+  if (!ngxIsLarge(size)) {
+    ngxPoolStat(ThreadPolicy::fetchAdd(counters_.smallAllocs_, (size_t)1));
     return ngxPallocSmall(size, 1);
   }
   return ngxPallocLarge(size);
 }
 
 //* 从内存池申请大小为 size 字节的内存，不考虑内存字节对齐
-void *NgxMemPool::ngxPnalloc(size_t size) {
-  if (size <= pool_->max_) {
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPnalloc(size_t size) {
+  if (!ngxIsLarge(size)) {
+    ngxPoolStat(ThreadPolicy::fetchAdd(counters_.smallAllocs_, (size_t)1));
     return ngxPallocSmall(size, 0);
   }
   return ngxPallocLarge(size);
 }
 
 //* 同 ngxPnalloc，但将内存初始化为 0
-void *NgxMemPool::ngxPcalloc(size_t size) {
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPcalloc(size_t size) {
   void *p;
   p = ngxPalloc(size);
   if (p) {
@@ -100,28 +114,213 @@ void *NgxMemPool::ngxPcalloc(size_t size) {
 }
 
 //* 释放大块内存
-void NgxMemPool::ngxPfree(void *p) {
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxPfree(void *p) {
   NgxPoolLarge  *l;
+  void *start;
+  size_t size;
+  PageSource *source;
+  bool cached;
 
-  for (l = pool_->large_; l; l = l->next_) {
-    if (p == l->alloc_) {
-        free(l->alloc_);
-        l->alloc_ = nullptr;
-        return;
+  {
+    std::lock_guard<typename ThreadPolicy::Mutex> lock(largeMtx_);
+    //* 通过散列表找到头部信息，p 不是本内存池的大块内存时什么也不做
+    size_t slot = largeFind(p);
+    if (slot == largeTable_.size()) {
+      return;
+    }
+    l = largeTable_[slot];
+    largeErase(slot);
+
+    //* 从双向链表中摘除，头部信息放入空闲链表供下次复用
+    if (l->prev_) {
+      l->prev_->next_ = l->next_;
+    } else {
+      pool_->large_ = l->next_;
+    }
+    if (l->next_) {
+      l->next_->prev_ = l->prev_;
+    }
+    start = l->start_;
+    size = l->size_;
+    source = l->source_;
+    l->alloc_ = nullptr;
+    l->next_ = pool_->largeFree_;
+    pool_->largeFree_ = l;
+    cached = largeCachePut(start, size, source);
+  }
+
+  ngxPoolStat(ThreadPolicy::fetchAdd(counters_.largeFrees_, (size_t)1));
+  if (!cached) {
+    source->deallocate(start, size);
+  }
+}
+
+//* Fibonacci 散列，取乘积的高 largeBits_ 位；地址低 4 位总是 0，先移掉
+template <typename ThreadPolicy>
+size_t NgxBasicMemPool<ThreadPolicy>::largeSlot(void *p) const {
+  return (size_t)((((uintptr_t)p >> 4) * 0x9E3779B97F4A7C15UL) >> (64 - largeBits_));
+}
+
+template <typename ThreadPolicy>
+size_t NgxBasicMemPool<ThreadPolicy>::largeFind(void *p) const {
+  if (largeUsed_ == 0 || p == nullptr) {
+    return largeTable_.size();
+  }
+  size_t mask = largeTable_.size() - 1;
+  for (size_t i = largeSlot(p); largeTable_[i]; i = (i + 1) & mask) {
+    if (largeTable_[i]->alloc_ == p) {
+      return i;
+    }
+  }
+  return largeTable_.size();
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::largeInsert(NgxPoolLarge *large) {
+  //* 装载率超过一半时容量翻倍，重新登记所有大块内存
+  if ((largeUsed_ + 1) * 2 > largeTable_.size()) {
+    std::vector<NgxPoolLarge *> old;
+    old.swap(largeTable_);
+    largeBits_ = largeBits_ == 0 ? 4 : largeBits_ + 1;
+    largeTable_.assign((size_t)1 << largeBits_, nullptr);
+    largeUsed_ = 0;
+    for (NgxPoolLarge *l : old) {
+      if (l) {
+        largeInsert(l);
+      }
+    }
+  }
+
+  size_t mask = largeTable_.size() - 1;
+  size_t i = largeSlot(large->alloc_);
+  while (largeTable_[i]) {
+    i = (i + 1) & mask;
+  }
+  largeTable_[i] = large;
+  ++largeUsed_;
+}
+
+//* 线性探测的后移删除：把探测链上后面的元素逐个前移填补空位，之后的查找不受影响
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::largeErase(size_t slot) {
+  size_t mask = largeTable_.size() - 1;
+  size_t i = slot;
+  largeTable_[i] = nullptr;
+  --largeUsed_;
+  for (size_t j = (i + 1) & mask; largeTable_[j]; j = (j + 1) & mask) {
+    size_t k = largeSlot(largeTable_[j]->alloc_);
+    //* k 循环意义上落在 (i, j] 内时，j 处的元素不能前移到 i
+    bool stay = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+    if (!stay) {
+      largeTable_[i] = largeTable_[j];
+      largeTable_[j] = nullptr;
+      i = j;
     }
   }
 }
 
+//* 尺寸桶：不超过 4KB 为第 0 级，之后每翻一倍分 4 级，步长为所在区间下界的 1/4，到 4MB 为第 40 级
+template <typename ThreadPolicy>
+int NgxBasicMemPool<ThreadPolicy>::largeBucket(size_t size) {
+  if (size <= 4096) {
+    return 0;
+  }
+  int shift = 63 - __builtin_clzl(size - 1);      //* size 落在 (2^shift, 2^(shift+1)]
+  size_t steps = (size - 1) >> (shift - 2);        //* 向上取整到 2^(shift-2) 的倍数后为 steps + 1 步
+  int bucket = (shift - 12) * 4 + (int)steps - 3;
+  return bucket < kLargeBuckets ? bucket : -1;
+}
+
+template <typename ThreadPolicy>
+size_t NgxBasicMemPool<ThreadPolicy>::largeBucketSize(int bucket) {
+  if (bucket == 0) {
+    return 4096;
+  }
+  int shift = (bucket - 1) / 4 + 12;
+  return (size_t)((bucket - 1) % 4 + 5) << (shift - 2);
+}
+
+//* 调用者持有 largeMtx_ 或独占内存池；只缓存来自 source_、大小恰为某个桶尺寸的大块内存
+template <typename ThreadPolicy>
+bool NgxBasicMemPool<ThreadPolicy>::largeCachePut(void *p, size_t size, PageSource *source) {
+  if (largeCacheMax_ == 0 || source != source_ || largeCachedBytes_ + size > largeCacheMax_) {
+    return false;
+  }
+  int bucket = largeBucket(size);
+  if (bucket < 0 || largeBucketSize(bucket) != size) {
+    return false;
+  }
+  *(void **)p = largeBuckets_[bucket];
+  largeBuckets_[bucket] = p;
+  largeCachedBytes_ += size;
+  ngxPoolStat(ThreadPolicy::fetchAdd(counters_.largeCached_, (size_t)1));
+  return true;
+}
+
+//* 从最大的桶开始交还，直到缓存不超过 limit 字节
+template <typename ThreadPolicy>
+size_t NgxBasicMemPool<ThreadPolicy>::largeCacheShrink(size_t limit) {
+  void *dropped[kLargeBuckets] = {};
+  size_t released = 0;
+  {
+    std::lock_guard<typename ThreadPolicy::Mutex> lock(largeMtx_);
+    for (int i = kLargeBuckets - 1; i >= 0 && largeCachedBytes_ > limit; --i) {
+      size_t size = largeBucketSize(i);
+      while (largeBuckets_[i] && largeCachedBytes_ > limit) {
+        void *p = largeBuckets_[i];
+        largeBuckets_[i] = *(void **)p;
+        *(void **)p = dropped[i];
+        dropped[i] = p;
+        largeCachedBytes_ -= size;
+      }
+    }
+  }
+  for (int i = 0; i < kLargeBuckets; ++i) {
+    while (dropped[i]) {
+      void *next = *(void **)dropped[i];
+      source_->deallocate(dropped[i], largeBucketSize(i));
+      released += largeBucketSize(i);
+      dropped[i] = next;
+    }
+  }
+  return released;
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxSetLargeCache(size_t maxBytes) {
+  {
+    std::lock_guard<typename ThreadPolicy::Mutex> lock(largeMtx_);
+    largeCacheMax_ = maxBytes;
+  }
+  largeCacheShrink(maxBytes);
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxSetMmapThreshold(size_t bytes) {
+  std::lock_guard<typename ThreadPolicy::Mutex> lock(largeMtx_);
+  mmapThreshold_ = bytes;
+}
+
+template <typename ThreadPolicy>
+size_t NgxBasicMemPool<ThreadPolicy>::ngxTrimLargeCache() {
+  return largeCacheShrink(0);
+}
+
 //* 重置内存池
-void NgxMemPool::ngxResetPool() {
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxResetPool() {
   NgxPool *p;
   NgxPoolLarge *l;
 
+  //* 清理记录和 ngxCreate 构造的对象都位于即将复用的内存中，先按逆序执行清理
+  runCleanups();
+
   //* 遍历大块内存的内存头
   for (l = pool_->large_; l; l = l->next_) {
-    //* 如果内存头中的大块内存不为空，释放掉
-    if (l->alloc_) {
-      free(l->alloc_);
+    //* 如果内存头中的大块内存不为空，放入尺寸桶缓存，放不下则释放掉
+    if (l->alloc_ && !largeCachePut(l->start_, l->size_, l->source_)) {
+      l->source_->deallocate(l->start_, l->size_);
     }
   }
 
@@ -140,13 +339,19 @@ void NgxMemPool::ngxResetPool() {
   p->d_.last_ = (u_char *)p + sizeof(NgxPool);
   p->d_.failed_ = 0;
   for (p = p->d_.next_; p; p = p->d_.next_) {
-      p->d_.last_ = (u_char *)p + sizeof(NgxPoolLarge);
+      //* 与 ngxPallocBlock 一致，后续内存块只保留 NgxPoolData 头部
+      p->d_.last_ = ngxAlignPtr((u_char *)p + sizeof(NgxPoolData), NGX_ALIGNMENT);
       p->d_.failed_ = 0;
   }
   //* 正确处理方式 end
 
   pool_->current_ = pool_;
   pool_->large_ = nullptr;
+  pool_->largeFree_ = nullptr;
+  pool_->chain_ = nullptr;
+  pool_->freeBufs_ = nullptr;
+  largeTable_.assign(largeTable_.size(), nullptr);
+  largeUsed_ = 0;
 }
 
 //* 销毁内存池
@@ -182,7 +387,8 @@ void NgxMemPool::ngxResetPool() {
 // }
 
 //* 添加清理外部资源操作
-NgxPoolCleanup *NgxMemPool::ngxCleanupAdd(size_t size) {
+template <typename ThreadPolicy>
+NgxPoolCleanup *NgxBasicMemPool<ThreadPolicy>::ngxCleanupAdd(size_t size) {
   NgxPoolCleanup *c;
 
   //* 在小块内存中开辟清理操作的头部信息
@@ -200,38 +406,588 @@ NgxPoolCleanup *NgxMemPool::ngxCleanupAdd(size_t size) {
     c->data_ = nullptr;
   }
 
-  //* 将头部信息连接在链表上
+  //* 将头部信息连接在链表上，并发时 CAS 头插
   c->handler_ = nullptr;
-  c->next_ = pool_->cleanup_;
-  pool_->cleanup_ = c;
+  c->next_ = ThreadPolicy::load(pool_->cleanup_);
+  while (!ThreadPolicy::compareExchange(pool_->cleanup_, c->next_, c)) {
+  }
 
   //* 返回头信息的起始地址
   return c;
 }
 
+template <typename ThreadPolicy>
+NgxChain *NgxBasicMemPool<ThreadPolicy>::ngxAllocChainLink() {
+  {
+    std::lock_guard<typename ThreadPolicy::Mutex> lock(chainMtx_);
+    NgxChain *cl = pool_->chain_;
+    if (cl) {
+      pool_->chain_ = cl->next_;
+      return cl;
+    }
+  }
+  return (NgxChain *)ngxPalloc(sizeof(NgxChain));
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxFreeChain(NgxChain *cl) {
+  std::lock_guard<typename ThreadPolicy::Mutex> lock(chainMtx_);
+  cl->next_ = pool_->chain_;
+  pool_->chain_ = cl;
+}
+
+//* 在回收的缓冲区中找第一个容量足够的，找不到再开辟缓冲区头部和 size 字节内存
+template <typename ThreadPolicy>
+NgxChain *NgxBasicMemPool<ThreadPolicy>::ngxGetTempBuf(size_t size) {
+  {
+    std::lock_guard<typename ThreadPolicy::Mutex> lock(chainMtx_);
+    for (NgxChain **ll = &pool_->freeBufs_; *ll; ll = &(*ll)->next_) {
+      NgxChain *cl = *ll;
+      if ((size_t)(cl->buf_->end_ - cl->buf_->start_) >= size) {
+        *ll = cl->next_;
+        cl->next_ = nullptr;
+        return cl;
+      }
+    }
+  }
+
+  NgxChain *cl = ngxAllocChainLink();
+  if (cl == nullptr) {
+    return nullptr;
+  }
+  NgxBuf *b = (NgxBuf *)ngxPcalloc(sizeof(NgxBuf));
+  u_char *m = b ? (u_char *)ngxPalloc(size) : nullptr;
+  if (m == nullptr) {
+    ngxFreeChain(cl);
+    return nullptr;
+  }
+  b->start_ = m;
+  b->pos_ = m;
+  b->last_ = m;
+  b->end_ = m + size;
+  b->temporary_ = 1;
+  cl->buf_ = b;
+  cl->next_ = nullptr;
+  return cl;
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxRecycleChain(NgxChain *cl) {
+  std::lock_guard<typename ThreadPolicy::Mutex> lock(chainMtx_);
+  while (cl) {
+    NgxChain *next = cl->next_;
+    NgxBuf *b = cl->buf_;
+    if (b && b->temporary_ && !b->inFile_) {
+      b->pos_ = b->start_;
+      b->last_ = b->start_;
+      cl->next_ = pool_->freeBufs_;
+      pool_->freeBufs_ = cl;
+    } else {
+      cl->next_ = pool_->chain_;
+      pool_->chain_ = cl;
+    }
+    cl = next;
+  }
+}
+
+//* 清理链表是头插的，从表头开始执行即为登记的逆序
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::runCleanups() {
+  for (NgxPoolCleanup *c = pool_->cleanup_; c; c = c->next_) {
+    if (c->handler_) {
+      c->handler_(c->data_);
+    }
+  }
+  pool_->cleanup_ = nullptr;
+}
+
+//* 不超过 NGX_ALIGNMENT 的对齐直接使用 ngxPalloc，更大的对齐多申请 align - 1 字节再上调起始地址
+//* 大小块按未补齐的 size 区分，与释放时的 ngxIsLarge(size) 一致；大块内存在 ngxPallocLarge 中对齐，
+//* 散列表登记对齐后的地址，ngxPfree 能找到它
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPallocAligned(size_t size, size_t align) {
+  if (align <= NGX_ALIGNMENT) {
+    return ngxPalloc(size);
+  }
+  if (ngxIsLarge(size)) {
+    return ngxPallocLarge(size, align);
+  }
+  ngxPoolStat(ThreadPolicy::fetchAdd(counters_.smallAllocs_, (size_t)1));
+  u_char *m = (u_char *)ngxPallocSmall(size + align - 1, 0);
+  return m ? ngxAlignPtr(m, align) : nullptr;
+}
+
+//* 与 ngx_array_push 的就地扩容相同：只有 p 恰好结束于某个内存块的 last_ 时才能扩大，并发时 CAS 推进 last_
+template <typename ThreadPolicy>
+bool NgxBasicMemPool<ThreadPolicy>::ngxPextend(void *p, size_t size, size_t more) {
+  u_char *end = (u_char *)p + size;
+  for (NgxPool *b = ThreadPolicy::load(pool_->current_); b; b = ThreadPolicy::load(b->d_.next_)) {
+    if (end <= (u_char *)b || end > b->d_.end_) {
+      continue;
+    }
+    u_char *last = end;
+    if ((size_t)(b->d_.end_ - end) < more) {
+      return false;
+    }
+    return ThreadPolicy::compareExchange(b->d_.last_, last, end + more);
+  }
+  return false;
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxSetBlockGrowth(size_t maxBlockSize) {
+  maxBlockSize_ = ngxAlign(maxBlockSize, source_->granularity());
+  if (maxBlockSize_ < blockSize_) {
+    maxBlockSize_ = blockSize_;
+  }
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxSetMaxSmall(size_t bytes) {
+  //* 已经开始分配时忽略：之前按旧的 max_ 判断的大块内存和小块内存在释放时会被误判
+  if (pool_->d_.last_ != (u_char *)pool_ + sizeof(NgxPool) || pool_->d_.next_ != nullptr
+      || pool_->large_ != nullptr || pool_->cleanup_ != nullptr) {
+    return;
+  }
+  //* 不超过最大的内存块除去头部后的可用部分
+  size_t limit = maxBlockSize_ - sizeof(NgxPool);
+  pool_->max_ = bytes < limit ? bytes : limit;
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxSetFailLimit(ngx_uint limit) {
+  failLimit_ = limit;
+}
+
+//* 先开辟保存点本身，再记录位置，保存点位于保存位置之前；回滚时把它所在内存块的 last_ 退回到它的起始处
+template <typename ThreadPolicy>
+NgxPoolMark NgxBasicMemPool<ThreadPolicy>::ngxMark() {
+  size_t n = 0;
+  for (NgxPool *p = pool_->current_; p; p = p->d_.next_) {
+    ++n;
+  }
+  //* 开辟保存点可能追加一个内存块，多留一项
+  size_t size = sizeof(NgxPoolSavepoint) + n * sizeof(NgxPoolSavepoint::blocks_[0]);
+  //* 始终从小块内存开辟，即使超过 max_，保证回滚时能收回
+  NgxPoolMark mark = (NgxPoolMark)ngxPallocSmall(size, 1);
+  if (mark == nullptr) {
+    return nullptr;
+  }
+
+  mark->current_ = pool_->current_;
+  mark->size_ = size;
+  mark->cleanup_ = pool_->cleanup_;
+  mark->largeSerial_ = largeSerial_;
+  mark->nblocks_ = 0;
+  for (NgxPool *p = pool_->current_; p; p = p->d_.next_) {
+    mark->blocks_[mark->nblocks_].last_ = p->d_.last_;
+    mark->blocks_[mark->nblocks_].failed_ = p->d_.failed_;
+    ++mark->nblocks_;
+  }
+  return mark;
+}
+
+template <typename ThreadPolicy>
+void NgxBasicMemPool<ThreadPolicy>::ngxRollback(NgxPoolMark mark) {
+  if (mark == nullptr) {
+    return;
+  }
+
+  //* 1. 逆序执行保存之后登记的清理
+  for (NgxPoolCleanup *c = pool_->cleanup_; c != mark->cleanup_; c = c->next_) {
+    if (c->handler_) {
+      c->handler_(c->data_);
+    }
+  }
+  pool_->cleanup_ = mark->cleanup_;
+
+  //* 2. 释放保存之后开辟的大块内存，large_ 按开辟顺序头插，序号从表头开始递减
+  while (pool_->large_ && pool_->large_->serial_ >= mark->largeSerial_) {
+    ngxPfree(pool_->large_->alloc_);
+  }
+  //* 空闲的头部信息、链表节点和缓冲区可能位于即将收回的内存中，全部丢弃
+  pool_->largeFree_ = nullptr;
+  pool_->chain_ = nullptr;
+  pool_->freeBufs_ = nullptr;
+
+  //* 3. 恢复小块内存；保存点在记录时已开辟，它所在的内存块退回到保存点的起始地址
+  u_char *end = (u_char *)mark + mark->size_;
+  size_t n = mark->nblocks_;
+  NgxPool *p = mark->current_;
+  for (size_t i = 0; i < n; ++i, p = p->d_.next_) {
+    p->d_.last_ = mark->blocks_[i].last_;
+    p->d_.failed_ = mark->blocks_[i].failed_;
+    if (p->d_.last_ == end) {
+      p->d_.last_ = (u_char *)mark;
+    }
+  }
+  //* 保存之后追加的内存块清空，留给之后的分配
+  for (; p; p = p->d_.next_) {
+    p->d_.last_ = ngxAlignPtr((u_char *)p + sizeof(NgxPoolData), NGX_ALIGNMENT);
+    p->d_.failed_ = 0;
+  }
+  pool_->current_ = mark->current_;
+}
+
+//* 内存池当前状态的快照
+template <typename ThreadPolicy>
+NgxPoolStats NgxBasicMemPool<ThreadPolicy>::ngxStats() const {
+  NgxPoolStats stats = {};
+  bool beforeCurrent = true;
+
+  for (NgxPool *p = pool_; p; p = p->d_.next_) {
+    if (p == pool_->current_) {
+      beforeCurrent = false;
+    }
+    ++stats.blockCount_;
+    stats.blockBytes_ += (size_t)(p->d_.end_ - (u_char *)p);
+    stats.failed_.push_back(p->d_.failed_);
+    //* current_ 之前的内存块不会再参与分配，剩余部分即为浪费
+    if (beforeCurrent) {
+      stats.tailWaste_ += (size_t)(p->d_.end_ - p->d_.last_);
+    } else {
+      stats.freeBytes_ += (size_t)(p->d_.end_ - p->d_.last_);
+    }
+  }
+
+  for (NgxPoolLarge *l = pool_->large_; l; l = l->next_) {
+    if (l->alloc_) {
+      ++stats.largeCount_;
+      stats.largeBytes_ += l->size_;
+    }
+  }
+
+  for (int i = 0; i < kLargeBuckets; ++i) {
+    for (void *b = largeBuckets_[i]; b; b = *(void **)b) {
+      ++stats.largeCachedCount_;
+      stats.largeCachedBytes_ += largeBucketSize(i);
+    }
+  }
+
+#if NGX_POOL_STATS
+  stats.counters_ = counters_;
+#endif
+  return stats;
+}
+
+std::string NgxPoolStats::toString(const char *prefix) const {
+  std::string out;
+  char line[128];
+  auto emit = [&](const char *name, const char *label, size_t value) {
+    snprintf(line, sizeof(line), "%s_%s%s %lu\n", prefix, name, label, value);
+    out += line;
+  };
+
+  emit("blocks", "", blockCount_);
+  emit("block_bytes", "", blockBytes_);
+  emit("tail_waste_bytes", "", tailWaste_);
+  emit("free_bytes", "", freeBytes_);
+  emit("large_blocks", "", largeCount_);
+  emit("large_bytes", "", largeBytes_);
+  emit("large_cached_blocks", "", largeCachedCount_);
+  emit("large_cached_bytes", "", largeCachedBytes_);
+  emit("small_allocs_total", "", counters_.smallAllocs_);
+  emit("large_allocs_total", "", counters_.largeAllocs_);
+  emit("large_frees_total", "", counters_.largeFrees_);
+  emit("block_allocs_total", "", counters_.blockAllocs_);
+  emit("large_reuses_total", "", counters_.largeReuses_);
+  emit("large_cached_total", "", counters_.largeCached_);
+  emit("mmap_allocs_total", "", counters_.mmapAllocs_);
+  for (size_t i = 0; i < failed_.size(); ++i) {
+    char label[32];
+    snprintf(label, sizeof(label), "{block=\"%lu\"}", i);
+    emit("block_failed", label, failed_[i]);
+  }
+  return out;
+}
+
+NgxBlockCache &NgxBlockCache::instance() {
+  //* 内存池可能在静态对象析构阶段才销毁，缓存本身不析构
+  static NgxBlockCache *cache = new NgxBlockCache();
+  return *cache;
+}
+
+NgxBlockCache::ThreadMagazines &NgxBlockCache::threadMagazines() {
+  static thread_local ThreadMagazines mags;
+  return mags;
+}
+
+NgxBlockCache::Magazine *NgxBlockCache::ThreadMagazines::find(PageSource *source, size_t size) {
+  for (Magazine &k : magazines_) {
+    if (k.source_ == source && k.size_ == size) {
+      return &k;
+    }
+  }
+  return nullptr;
+}
+
+//* 线程退出时把弹匣中的块全部交还全局仓库并注销，之后本线程的取还直接访问仓库
+NgxBlockCache::ThreadMagazines::~ThreadMagazines() {
+  NgxBlockCache &cache = instance();
+  std::vector<Depot> dropped;
+  {
+    std::lock_guard<std::mutex> lock(cache.mtx_);
+    std::lock_guard<std::mutex> own(mtx_);
+    for (Magazine &m : magazines_) {
+      if (m.count_ > 0) {
+        cache.flush(m, m.count_, dropped);
+      }
+    }
+    for (ThreadMagazines **t = &cache.threads_; *t != nullptr; t = &(*t)->next_) {
+      if (*t == this) {
+        *t = next_;
+        break;
+      }
+    }
+    released_ = true;
+  }
+  freeDropped(dropped);
+}
+
+NgxBlockCache::Depot *NgxBlockCache::findDepot(PageSource *source, size_t size) {
+  for (Depot &d : depots_) {
+    if (d.source_ == source && d.size_ == size) {
+      return &d;
+    }
+  }
+  return nullptr;
+}
+
+void NgxBlockCache::flush(Magazine &m, int n, std::vector<Depot> &dropped) {
+  Depot overflow{m.source_, m.size_, nullptr, 0};  //* 超出上限、要还给内存来源的块
+  size_t limit = highWater_.load(std::memory_order_relaxed);
+  Depot *d = findDepot(m.source_, m.size_);
+  if (d == nullptr) {
+    depots_.push_back(Depot{m.source_, m.size_, nullptr, 0});
+    d = &depots_.back();
+  }
+  for (int i = 0; i < n; ++i) {
+    void *p = m.blocks_[--m.count_];
+    if (cachedBytes_ + m.size_ <= limit) {
+      *(void **)p = d->head_;
+      d->head_ = p;
+      ++d->count_;
+      cachedBytes_ += m.size_;
+    } else {
+      *(void **)p = overflow.head_;
+      overflow.head_ = p;
+      ++overflow.count_;
+    }
+  }
+  if (overflow.head_ != nullptr) {
+    dropped.push_back(overflow);
+  }
+}
+
+void NgxBlockCache::enroll(ThreadMagazines &mags) {
+  if (!mags.registered_) {
+    mags.next_ = threads_;
+    threads_ = &mags;
+    mags.registered_ = true;
+  }
+}
+
+void NgxBlockCache::freeDropped(std::vector<Depot> &dropped) {
+  for (Depot &d : dropped) {
+    while (d.head_ != nullptr) {
+      void *next = *(void **)d.head_;
+      d.source_->deallocate(d.head_, d.size_);
+      d.head_ = next;
+    }
+  }
+}
+
+void *NgxBlockCache::get(PageSource *source, size_t size) {
+  ThreadMagazines &mags = threadMagazines();
+  //* 快速路径：本线程弹匣中有同样大小的块
+  {
+    std::lock_guard<std::mutex> own(mags.mtx_);
+    Magazine *m = mags.released_ ? nullptr : mags.find(source, size);
+    if (m != nullptr && m->count_ > 0) {
+      return m->blocks_[--m->count_];
+    }
+  }
+
+  //* 弹匣为空时从全局仓库取一块，同时为弹匣补充半匣
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Depot *d = findDepot(source, size);
+    if (d != nullptr && d->head_ != nullptr) {
+      void *p = d->head_;
+      d->head_ = *(void **)p;
+      --d->count_;
+      cachedBytes_ -= size;
+      std::lock_guard<std::mutex> own(mags.mtx_);
+      Magazine *m = mags.released_ ? nullptr : mags.find(source, size);
+      while (m != nullptr && m->count_ < kMagazineSize / 2 && d->head_ != nullptr) {
+        m->blocks_[m->count_++] = d->head_;
+        d->head_ = *(void **)d->head_;
+        --d->count_;
+        cachedBytes_ -= size;
+      }
+      return p;
+    }
+  }
+  return source->allocate(size);
+}
+
+void NgxBlockCache::put(PageSource *source, void *p, size_t size) {
+  if (highWater_.load(std::memory_order_relaxed) == 0) {
+    source->deallocate(p, size);
+    return;
+  }
+
+  ThreadMagazines &mags = threadMagazines();
+  //* 快速路径：已登记的线程把块放进同样大小、未满的弹匣
+  {
+    std::lock_guard<std::mutex> own(mags.mtx_);
+    Magazine *m = mags.registered_ && !mags.released_ ? mags.find(source, size) : nullptr;
+    if (m != nullptr && m->count_ < kMagazineSize) {
+      m->blocks_[m->count_++] = p;
+      return;
+    }
+  }
+
+  std::vector<Depot> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    std::lock_guard<std::mutex> own(mags.mtx_);
+    if (mags.released_) {
+      Magazine tmp{source, size, 1, {p}};
+      flush(tmp, 1, dropped);
+    } else {
+      enroll(mags);
+      Magazine *m = mags.find(source, size);
+      if (m == nullptr) {
+        for (Magazine &k : mags.magazines_) {
+          if (k.count_ == 0) {
+            m = &k;
+            break;
+          }
+        }
+      }
+      //* 弹匣都被其他大小占用，轮流腾出一个
+      if (m == nullptr) {
+        m = &mags.magazines_[mags.victim_];
+        mags.victim_ = (mags.victim_ + 1) % kMagazines;
+        flush(*m, m->count_, dropped);
+      }
+      if (m->count_ == 0) {
+        m->source_ = source;
+        m->size_ = size;
+      }
+
+      //* 弹匣已满时先把半匣交还全局仓库
+      if (m->count_ == kMagazineSize) {
+        flush(*m, kMagazineSize / 2, dropped);
+      }
+      m->blocks_[m->count_++] = p;
+    }
+  }
+  freeDropped(dropped);
+}
+
+//* 调低上限时立即把仓库中超出的块还给各自的内存来源
+void NgxBlockCache::setHighWater(size_t bytes) {
+  highWater_.store(bytes, std::memory_order_relaxed);
+
+  std::vector<Depot> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (Depot &d : depots_) {
+      Depot extra{d.source_, d.size_, nullptr, 0};
+      while (cachedBytes_ > bytes && d.head_ != nullptr) {
+        void *p = d.head_;
+        d.head_ = *(void **)p;
+        --d.count_;
+        cachedBytes_ -= d.size_;
+        *(void **)p = extra.head_;
+        extra.head_ = p;
+      }
+      if (extra.head_ != nullptr) {
+        dropped.push_back(extra);
+      }
+    }
+  }
+  freeDropped(dropped);
+}
+
+size_t NgxBlockCache::highWater() const {
+  return highWater_.load(std::memory_order_relaxed);
+}
+
+size_t NgxBlockCache::cachedBytes() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return cachedBytes_;
+}
+
+//* 逐个加锁清空所有登记过的线程弹匣中属于 source 的块，并清掉弹匣的归属，
+//* 之后这些线程不会再把 source 的块留在弹匣、交还仓库或还给已经销毁的 source
+void NgxBlockCache::release(PageSource *source) {
+  std::vector<Depot> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (ThreadMagazines *t = threads_; t != nullptr; t = t->next_) {
+      std::lock_guard<std::mutex> own(t->mtx_);
+      for (Magazine &m : t->magazines_) {
+        if (m.source_ != source) {
+          continue;
+        }
+        Depot extra{source, m.size_, nullptr, 0};
+        while (m.count_ > 0) {
+          void *p = m.blocks_[--m.count_];
+          *(void **)p = extra.head_;
+          extra.head_ = p;
+          ++extra.count_;
+        }
+        m.source_ = nullptr;
+        m.size_ = 0;
+        if (extra.head_ != nullptr) {
+          dropped.push_back(extra);
+        }
+      }
+    }
+    for (size_t i = 0; i < depots_.size(); ) {
+      if (depots_[i].source_ == source) {
+        cachedBytes_ -= depots_[i].count_ * depots_[i].size_;
+        dropped.push_back(depots_[i]);
+        depots_[i] = depots_.back();
+        depots_.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+  freeDropped(dropped);
+}
+
 //* 小块内存分配
-void *NgxMemPool::ngxPallocSmall(size_t size, ngx_uint align) {
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPallocSmall(size_t size, ngx_uint align) {
   u_char *m;
   NgxPool *p;
   //* 从 current 指向的内存块分配内存
-  p = pool_->current_;
+  p = ThreadPolicy::load(pool_->current_);
 
   do {
-    //* m 指向可分配内存的起始地址
-    m = p->d_.last_;
+    //* last 指向可分配内存的起始地址
+    u_char *last = ThreadPolicy::load(p->d_.last_);
 
-    //* 如果考虑内存对齐，将 m 调整为 unsigned long 的整数倍
-    if (align) {
-      m = ngxAlignPtr(m, NGX_ALIGNMENT);
-    }
+    for (;;) {
+      //* 如果考虑内存对齐，将 m 调整为 unsigned long 的整数倍
+      m = align ? ngxAlignPtr(last, NGX_ALIGNMENT) : last;
 
-    //* 判断可用 size 是否足够分配给当前要申请的 size
-    if ((size_t) (p->d_.end_ - m) >= size) {
-      p->d_.last_ = m + size;
-      return m;
+      //* 判断可用 size 是否足够分配给当前要申请的 size
+      if ((size_t) (p->d_.end_ - m) < size) {
+        break;
+      }
+      //* 推进 last；并发时其他线程抢先推进则 CAS 失败，last 更新为最新值后重试
+      if (ThreadPolicy::compareExchange(p->d_.last_, last, m + size)) {
+        return m;
+      }
     }
     //* 如果可用内存不足以分配 size，切换下一个内存块
-    p = p->d_.next_;
+    p = ThreadPolicy::load(p->d_.next_);
 
   } while (p);
 
@@ -240,19 +996,28 @@ void *NgxMemPool::ngxPallocSmall(size_t size, ngx_uint align) {
 }
 
 //* 分配新的小块内存池
-void *NgxMemPool::ngxPallocBlock(size_t size) {
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPallocBlock(size_t size) {
     u_char *m;
     size_t pSize;
     NgxPool *p, *newP;
 
-    //* 计算当前内存块的总 size
-    pSize = (size_t)(pool_->d_.end_ - (u_char *)pool_);
+    //* 新内存块的大小：按设定倍增，且至少能放下本次申请
+    pSize = ThreadPolicy::load(blockSize_);
+    if (pSize < maxBlockSize_) {
+        ThreadPolicy::store(blockSize_, pSize * 2 < maxBlockSize_ ? pSize * 2 : maxBlockSize_);
+    }
+    size_t need = ngxAlign(sizeof(NgxPoolData), NGX_ALIGNMENT) + size;
+    if (pSize < need) {
+        pSize = ngxAlign(need, source_->granularity());
+    }
 
-    //* 开辟一个相同大小的内存块， m 指向起始地址
-    m = (u_char *)malloc(pSize);
+    //* 开辟新的内存块， m 指向起始地址，优先复用块缓存中的块
+    m = (u_char *)NgxBlockCache::instance().get(source_, pSize);
     if (m == nullptr) {
         return nullptr;
     }
+    ngxPoolStat(ThreadPolicy::fetchAdd(counters_.blockAllocs_, (size_t)1));
 
     //* newP 指向内存块起始地址
     newP = (NgxPool *) m;
@@ -269,59 +1034,111 @@ void *NgxMemPool::ngxPallocBlock(size_t size) {
     newP->d_.last_ = m + size;
 
     //* 如果在当前遍历的内存块上申请内存失败的次数大于 4，代表该内存块可使用空间已消耗殆尽，需更换申请对象
-    for (p = pool_->current_; p->d_.next_; p = p->d_.next_) {
-        if (p->d_.failed_++ > 4) {
-            pool_->current_ = p->d_.next_;
+    //* 并发时 current_ 只在仍指向 p 时才前移，不会被其他线程退回
+    NgxPool *next;
+    for (p = ThreadPolicy::load(pool_->current_); ; p = next) {
+        next = nullptr;
+        //* 将新申请的内存块与传入的内存块连起来；并发时其他线程抢先挂上了新块则继续向后找末尾
+        if (ThreadPolicy::compareExchange(p->d_.next_, next, newP)) {
+            break;
+        }
+        if (ThreadPolicy::fetchAdd(p->d_.failed_, (ngx_uint)1) > failLimit_) {
+            NgxPool *cur = p;
+            ThreadPolicy::compareExchange(pool_->current_, cur, next);
         }
     }
 
-    //* 将新申请的内存块与传入的内存块连起来
-    p->d_.next_ = newP;
-
     return m;
 }
 
 //* 大块内存分配
-void *NgxMemPool::ngxPallocLarge(size_t size) {
-    void *p;
-    ngx_uint n;
+template <typename ThreadPolicy>
+void *NgxBasicMemPool<ThreadPolicy>::ngxPallocLarge(size_t size, size_t align) {
+    void *p = nullptr;
     NgxPoolLarge *large;
+    PageSource *source = source_;
 
-    //* 通过 malloc 调用指定大小的大块内存
-    p = malloc(size);
-    if (p == nullptr) {
-        return nullptr;
+    //* 按更大的对齐开辟时多申请 align - 1 字节，交还和缓存仍以来源开辟的地址和大小为准
+    if (align > NGX_ALIGNMENT) {
+        if (size > (size_t)-1 - align) {
+            return nullptr;
+        }
+        size += align - 1;
+    } else {
+        align = 0;
     }
 
-    n = 0;
-
-    //* 先遍历大块内存的内存头，将内存头中已经 free 的大块内存赋值为新开辟的大块内存
-    for (large = pool_->large_; large; large = large->next_) {
-        if (large->alloc_ == nullptr) {
-            large->alloc_ = p;
-            return p;
+    std::unique_lock<typename ThreadPolicy::Mutex> lock(largeMtx_);
+    if (mmapThreshold_ != 0 && size >= mmapThreshold_) {
+        //* 超过阈值的大块内存直接 mmap，释放时可以完整地交还操作系统
+        source = mmapPageSource();
+    } else if (largeCacheMax_ != 0) {
+        //* 按尺寸桶开辟，桶中有空闲的大块内存时直接复用
+        int bucket = largeBucket(size);
+        if (bucket >= 0) {
+            size = largeBucketSize(bucket);
+            p = largeBuckets_[bucket];
+            if (p) {
+                largeBuckets_[bucket] = *(void **)p;
+                largeCachedBytes_ -= size;
+                ngxPoolStat(ThreadPolicy::fetchAdd(counters_.largeReuses_, (size_t)1));
+            }
         }
+    }
 
-        //* 考虑效率，不遍历太多次
-        if (n++ > 3) {
-            break;
+    //* 优先复用已释放的大块内存头部信息，O(1) 取得
+    large = pool_->largeFree_;
+    if (large) {
+        pool_->largeFree_ = large->next_;
+    }
+    //* 开辟大块内存、内存头以及失败时的交还都不持有锁，最后加锁挂入链表
+    lock.unlock();
+
+    if (p == nullptr) {
+        //* 通过内存来源开辟指定大小的大块内存
+        p = source->allocate(size);
+        if (p == nullptr) {
+            if (large) {
+                lock.lock();
+                large->next_ = pool_->largeFree_;
+                pool_->largeFree_ = large;
+            }
+            return nullptr;
         }
+        ngxPoolStat(ThreadPolicy::fetchAdd(counters_.largeAllocs_, (size_t)1));
+        ngxPoolStat(if (source != source_) ThreadPolicy::fetchAdd(counters_.mmapAllocs_, (size_t)1));
     }
 
-    //* 大块内存的内存头在小块内存中开辟，内存头中的 alloc 指向大块内存的起始地址
-    large = (NgxPoolLarge *)ngxPallocSmall(sizeof(NgxPoolLarge), 1);
-    //* 如果内存头在小块内存中开辟失败，将刚刚通过 malloc 申请的大块内存 free 掉(对比小块内存不释放)
     if (large == nullptr) {
-        free(p);
-        return nullptr;
+        //* 大块内存的内存头在小块内存中开辟，内存头中的 alloc 指向大块内存的起始地址
+        large = (NgxPoolLarge *)ngxPallocSmall(sizeof(NgxPoolLarge), 1);
+        //* 如果内存头在小块内存中开辟失败，将刚刚开辟的大块内存还给内存来源(对比小块内存不释放)
+        if (large == nullptr) {
+            source->deallocate(p, size);
+            return nullptr;
+        }
     }
 
-    //* 记录大块内存的起始地址
-    large->alloc_ = p;
-    //* 头插法连接大块内存的内存头
+    lock.lock();
+    //* 记录大块内存的起始地址、大小和来源
+    large->start_ = p;
+    large->alloc_ = align ? ngxAlignPtr(p, align) : p;
+    large->size_ = size;
+    large->source_ = source;
+    large->serial_ = largeSerial_++;
+    //* 头插法连接大块内存的内存头，并登记到散列表
+    large->prev_ = nullptr;
     large->next_ = pool_->large_;
+    if (large->next_) {
+        large->next_->prev_ = large;
+    }
     pool_->large_ = large;
+    largeInsert(large);
 
-    return p;
+    return large->alloc_;
 }
 
+
+
+template class NgxBasicMemPool<NgxSingleThread>;
+template class NgxBasicMemPool<NgxMultiThread>;
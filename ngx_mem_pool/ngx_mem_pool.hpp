@@ -3,10 +3,23 @@
 
 #include <stdlib.h>
 #include <memory.h>
-#include <functional>
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "page_source.hpp"
 
 struct NgxPool;
 struct NgxPoolLarge;
+struct NgxChain;
+
+#ifndef NGX_POOL_STATS
+#define NGX_POOL_STATS 0  //* 置 1 则统计小块内存、大块内存、内存块的分配次数，关闭时计数代码完全不参与编译
+#endif
 
 #ifndef NGX_ALIGNMENT
 #define NGX_ALIGNMENT sizeof(unsigned long) //* 小块内存考虑内存字节对齐时的单位
@@ -23,10 +36,15 @@ using size_t = unsigned long;
 #define ngxAlignPtr(p, a) (u_char *)(((uintptr_t)(p) + ((uintptr_t)a - 1)) & ~((uintptr_t)a - 1))
 //* 内存清零
 #define ngx_memzero(buf, n) (void)memset(buf, 0, n)
+//* 统计计数，NGX_POOL_STATS 关闭时展开为空
+#if NGX_POOL_STATS
+#define ngxPoolStat(stmt) stmt
+#else
+#define ngxPoolStat(stmt)
+#endif
 
-//* 用于清理外部资源的函数指针
-// typedef void (*NgxPoolCleanupPt)(void *data);
-using NgxPoolCleanupPt = std::function<void(void *)>;
+//* 用于清理外部资源的函数指针，普通函数指针，不像 std::function 那样可能开辟堆内存
+typedef void (*NgxPoolCleanupPt)(void *data);
 
 //* 清理操作的回调函数等相关数据
 struct NgxPoolCleanup {
@@ -37,8 +55,13 @@ struct NgxPoolCleanup {
 
 //* 大块内存的头部信息
 struct NgxPoolLarge {
-  NgxPoolLarge      *next_;      //* 用链表串接大块内存
-  void              *alloc_;     //* 分配出去的大块内存的起始地址
+  NgxPoolLarge      *next_;      //* 用链表串接大块内存；空闲的头部信息也用它串成空闲链表
+  NgxPoolLarge      *prev_;      //* 双向链表的前一个，释放时 O(1) 摘除
+  void              *alloc_;     //* 分配出去的大块内存的起始地址，散列表以它为键
+  void              *start_;     //* 内存来源开辟的起始地址，按更大的对齐开辟时 alloc_ 位于其后；交还和缓存时使用
+  size_t            size_;       //* 大块内存的字节数，归还给内存来源时使用
+  PageSource        *source_;    //* 开辟该大块内存的来源，超过 mmap 阈值的来自 mmapPageSource()
+  size_t            serial_;     //* 开辟时的序号，回滚到保存点时据此找出之后开辟的大块内存
 };
 
 //* 小块内存的头部信息
@@ -54,8 +77,53 @@ struct NgxPool {
   NgxPoolData       d_;          //* 当前小块内存的使用情况
   size_t            max_;        //* 当前小块内存的最大尺寸，与大块内存区分
   NgxPool           *current_;   //* 指向内存池可分配的第一个小块内存
-  NgxPoolLarge      *large_;     //* 指向大块内存的入口地址
+  NgxPoolLarge      *large_;     //* 指向大块内存的入口地址，链表上只有仍在使用的大块内存
+  NgxPoolLarge      *largeFree_; //* 已释放的大块内存头部信息，ngxPallocLarge 优先复用
   NgxPoolCleanup    *cleanup_;   //* 所有清理操作的入口地址
+  NgxChain          *chain_;     //* 回收的缓冲区链表节点，ngxAllocChainLink 优先复用
+  NgxChain          *freeBufs_;  //* 回收的内存缓冲区(连同节点)，ngxGetTempBuf 优先复用
+};
+
+//* ngxMark 返回的保存点，记录在内存池自身的小块内存中，回滚时一并收回
+struct NgxPoolSavepoint {
+  NgxPool           *current_;   //* 保存时的 current_
+  NgxPoolCleanup    *cleanup_;   //* 保存时的清理链表头，之后登记的清理记录都在它前面
+  size_t            largeSerial_;  //* 保存时下一个大块内存的序号
+  size_t            size_;       //* 保存点本身占用的字节数
+  size_t            nblocks_;    //* 从 current_ 到最后一个内存块的个数
+  struct {
+    u_char          *last_;
+    ngx_uint        failed_;
+  } blocks_[1];                  //* 这些内存块保存时的 d_.last_ 和 d_.failed_，实际长度为 nblocks_
+};
+
+using NgxPoolMark = NgxPoolSavepoint *;
+
+//* 内存池的分配计数，并发内存池中通过线程策略原子地累加
+struct NgxPoolCounters {
+  size_t            smallAllocs_;   //* 从小块内存分配的次数
+  size_t            largeAllocs_;   //* 大块内存分配次数
+  size_t            largeFrees_;    //* 通过 ngxPfree 释放大块内存的次数
+  size_t            blockAllocs_;   //* ngxPallocBlock 开辟新内存块的次数
+  size_t            largeReuses_;   //* 大块内存由尺寸桶缓存直接提供的次数
+  size_t            largeCached_;   //* 释放或重置时大块内存放入尺寸桶缓存的次数
+  size_t            mmapAllocs_;    //* 超过 mmap 阈值、直接 mmap 开辟大块内存的次数
+};
+
+//* ngxStats 返回的内存池快照
+struct NgxPoolStats {
+  size_t            blockCount_;    //* 小块内存块个数
+  size_t            blockBytes_;    //* 小块内存块总字节数
+  std::vector<ngx_uint> failed_;    //* 每个内存块的 failed_ 计数，按链表顺序
+  size_t            tailWaste_;     //* current_ 之前、不再参与分配的内存块尾部浪费的字节数
+  size_t            freeBytes_;     //* current_ 及之后的内存块中仍可分配的字节数
+  size_t            largeCount_;    //* 当前持有的大块内存个数
+  size_t            largeBytes_;    //* 当前持有的大块内存字节数
+  size_t            largeCachedCount_;  //* 尺寸桶缓存中的大块内存个数
+  size_t            largeCachedBytes_;  //* 尺寸桶缓存中的大块内存字节数
+  NgxPoolCounters   counters_;      //* 分配计数，需开启 NGX_POOL_STATS，否则全为 0
+
+  std::string toString(const char *prefix = "ngx_pool") const;  //* 按 "名称 数值" 逐行输出
 };
 
 const int ngxPageSize = 4096;                             //* 物理页大小 4k
@@ -65,27 +133,389 @@ const int NGX_POOL_ALLGNMENT = 16;                        //* 内存池对齐尺
 const int NGX_MIN_POOL_SIZE = ngxAlign((sizeof(NgxPool) + 2 * sizeof(NgxPoolLarge))
                                   , NGX_POOL_ALLGNMENT);  //* 小块内存最小尺寸
 
-class NgxMemPool {
+//* 进程级的内存块缓存，按 (内存来源, 块大小) 回收内存池的内存块
+//* 每请求创建、销毁一个内存池时，内存池头所在的块和 ngxPallocBlock 追加的块都从这里取、还到这里，
+//* 不再每次经过 malloc/free 或 mmap/munmap
+//* 每个线程在前面有几个小弹匣，只与本线程有关的取还只加本线程弹匣的锁，几乎没有竞争；
+//* 弹匣满或空时整批与全局仓库交换，全局仓库缓存的字节数超过上限后多出的块直接还给内存来源
+//* 自定义的 PageSource 销毁前须调用 release(source)，交还仓库和所有线程弹匣中属于它的块
+class NgxBlockCache {
+public:
+  static const int kMagazineSize = 8;      //* 每个弹匣最多保存的块数
+  static const int kMagazines = 4;         //* 每个线程的弹匣个数，不同块大小各占一个
+  static const size_t kDefaultHighWater = 64 * 1024 * 1024;  //* 全局仓库默认的字节上限
+
+  static NgxBlockCache &instance();        //* 进程唯一的实例，永不析构
+
+  void *get(PageSource *source, size_t size);           //* 取一个 size 字节的块，缓存为空时向 source 申请
+  void put(PageSource *source, void *p, size_t size);   //* 归还一个 get 取得的块
+  void setHighWater(size_t bytes);         //* 设置全局仓库的字节上限，0 表示不再缓存
+  size_t highWater() const;
+  size_t cachedBytes();                    //* 全局仓库中缓存的字节数，不含各线程弹匣
+  void release(PageSource *source);        //* 将仓库和各线程弹匣中属于 source 的块还给 source
+
+private:
+  //* 某个 (内存来源, 块大小) 的空闲块，块的第一个字存放下一块的地址
+  struct Depot {
+    PageSource      *source_;
+    size_t          size_;
+    void            *head_;
+    size_t          count_;
+  };
+
+  struct Magazine {
+    PageSource      *source_;
+    size_t          size_;
+    int             count_;
+    void            *blocks_[kMagazineSize];
+  };
+
+  //* 弹匣由 mtx_ 保护，本线程之外只有 release 会访问；同时加两把锁时总是先 NgxBlockCache::mtx_
+  struct ThreadMagazines {
+    Magazine        magazines_[kMagazines];
+    int             victim_;               //* 弹匣用完时轮流腾出的下标
+    bool            registered_;           //* 已登记到 threads_，release 能找到它
+    bool            released_;             //* 线程退出时已交还全局仓库
+    ThreadMagazines *next_;                //* 已登记的弹匣串成链表，由 NgxBlockCache::mtx_ 保护
+    std::mutex      mtx_;
+    Magazine *find(PageSource *source, size_t size);
+    ~ThreadMagazines();
+  };
+
+  NgxBlockCache() = default;
+  static ThreadMagazines &threadMagazines();
+  Depot *findDepot(PageSource *source, size_t size);  //* 调用者持有 mtx_
+  //* 将弹匣顶部 n 块交还全局仓库，调用者持有 mtx_；超出上限的块放入 dropped，由调用者在锁外交还
+  void flush(Magazine &m, int n, std::vector<Depot> &dropped);
+  void enroll(ThreadMagazines &mags);                 //* 登记本线程的弹匣，调用者持有 mtx_
+  static void freeDropped(std::vector<Depot> &dropped);  //* 将 dropped 中的块还给各自的内存来源
+
+  std::mutex mtx_;                         //* 保护 depots_、cachedBytes_ 和 threads_
+  std::vector<Depot> depots_;
+  size_t cachedBytes_ = 0;
+  ThreadMagazines *threads_ = nullptr;     //* 所有登记过的线程弹匣
+  std::atomic<size_t> highWater_{kDefaultHighWater};
+};
+
+//* 单线程策略：所有读写都是普通访问，与不区分线程策略时生成的代码完全相同
+struct NgxSingleThread {
+  template <typename T>
+  static T load(const T &v) { return v; }
+  template <typename T>
+  static void store(T &v, T x) { v = x; }
+  //* v 等于 expected 时写入 desired 并返回 true，否则把 v 的当前值写回 expected 并返回 false
+  template <typename T>
+  static bool compareExchange(T &v, T &expected, T desired) {
+    if (v != expected) {
+      expected = v;
+      return false;
+    }
+    v = desired;
+    return true;
+  }
+  template <typename T>
+  static T fetchAdd(T &v, T n) {
+    T old = v;
+    v += n;
+    return old;
+  }
+  //* 不做任何事的锁
+  struct Mutex {
+    void lock() {}
+    void unlock() {}
+  };
+};
+
+//* 多线程策略：同一组字段改用 GCC 的 __atomic 内建函数访问，内存块、大块内存头、清理头的布局不变
+//* 新发布的节点(内存块、大块内存头、清理头)以 release 写入链表，读取方以 acquire 读取后即可看到其内容
+struct NgxMultiThread {
+  template <typename T>
+  static T load(const T &v) { return __atomic_load_n(&v, __ATOMIC_ACQUIRE); }
+  template <typename T>
+  static void store(T &v, T x) { __atomic_store_n(&v, x, __ATOMIC_RELEASE); }
+  template <typename T>
+  static bool compareExchange(T &v, T &expected, T desired) {
+    return __atomic_compare_exchange_n(&v, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  }
+  template <typename T>
+  static T fetchAdd(T &v, T n) { return __atomic_fetch_add(&v, n, __ATOMIC_RELAXED); }
+  using Mutex = std::mutex;
+};
+
+//* ngx 内存池，ThreadPolicy 决定能否被多个线程同时使用
+//* NgxMultiThread 下 ngxPalloc、ngxPnalloc、ngxPcalloc、ngxPfree、ngxCleanupAdd 可以并发调用：
+//* 小块内存用 CAS 推进 d_.last_，新内存块 CAS 挂到链表末尾，清理头 CAS 头插；
+//* 大块内存的链表和散列表由 ThreadPolicy::Mutex 保护，开辟和归还大块内存本身在锁外进行
+//* ngxResetPool、ngxStats 和析构仍要求此时没有其他线程在使用内存池
+template <typename ThreadPolicy>
+class NgxBasicMemPool {
 public:
-  NgxMemPool(size_t size);
-  ~NgxMemPool();
+  NgxBasicMemPool(size_t size, PageSource *source = mallocPageSource());
+  ~NgxBasicMemPool();
   // void ngxCreatPool(size_t size);  //* 分配指定 size 大小的内存池，申请的小块内存不能超过设置的 max
   void *ngxPalloc(size_t size);     //* 从内存池申请大小为 size 字节的内存，考虑内存字节对齐
   void *ngxPnalloc(size_t size);    //* 从内存池申请大小为 size 字节的内存，不考虑内存字节对齐
   void *ngxPcalloc(size_t size);    //* 同 ngxPnalloc，但将内存初始化为 0
   void ngxPfree(void *p);           //* 释放大块内存
+  void *ngxPallocAligned(size_t size, size_t align);  //* 按 align 字节对齐开辟，align 为 2 的幂
+  //* 把小块内存中刚开辟的 p(size 字节) 就地扩大 more 字节，p 须是所在内存块最近一次分配且剩余空间足够，否则返回 false
+  bool ngxPextend(void *p, size_t size, size_t more);
   void ngxResetPool();              //* 重置内存池
   // void ngxDestoryPool();            //* 销毁内存池
   NgxPoolCleanup *ngxCleanupAdd(size_t size);         //* 添加清理外部资源操作
+  NgxPoolStats ngxStats() const;                      //* 内存池当前状态的快照
+
+  //* 缓冲区链表节点和内存缓冲区，结构定义和读写函数见 ngx_buf.hpp
+  //* 回收的节点和缓冲区挂在内存池上，ngxResetPool 或回滚到保存点时随小块内存一起作废
+  NgxChain *ngxAllocChainLink();                      //* 开辟一个链表节点，优先复用回收的节点
+  void ngxFreeChain(NgxChain *cl);                    //* 回收一个链表节点，不回收它的缓冲区
+  NgxChain *ngxGetTempBuf(size_t size);               //* 取一个至少有 size 字节空闲空间的空内存缓冲区
+  //* 回收整条链：持有内存的缓冲区连同节点放入空闲缓冲区链表，游标复位；其余缓冲区只回收节点
+  void ngxRecycleChain(NgxChain *cl);
+
+  //* 在内存池中就地构造一个 T，开辟失败返回 nullptr
+  //* T 不是平凡析构时登记一条清理记录，内存池重置或销毁时调用析构函数；
+  //* 清理记录按登记的逆序执行，后构造的对象先析构，与自动变量相同
+  template <typename T, typename... Args>
+  T *ngxCreate(Args &&...args) {
+    void *p = ngxPallocAligned(sizeof(T), alignof(T));
+    if (p == nullptr) {
+      return nullptr;
+    }
+    if (std::is_trivially_destructible<T>::value) {
+      return new (p) T(std::forward<Args>(args)...);
+    }
+    //* 先登记清理记录再构造，构造函数抛出异常时记录的 handler_ 仍为空，不会被调用
+    NgxPoolCleanup *c = ngxCleanupAdd(0);
+    if (c == nullptr) {
+      return nullptr;
+    }
+    T *obj = new (p) T(std::forward<Args>(args)...);
+    c->data_ = obj;
+    c->handler_ = &destroyObject<T>;
+    return obj;
+  }
+
+  //* 在内存池中就地值初始化 n 个 T，析构时按下标从大到小逐个析构
+  //* 某个元素的构造函数抛出异常时，已构造的元素先逆序析构，再重新抛出
+  template <typename T>
+  T *ngxCreateArray(size_t n) {
+    if (n != 0 && sizeof(T) > (size_t)-1 / n) {
+      return nullptr;
+    }
+    T *first = (T *)ngxPallocAligned(sizeof(T) * n, alignof(T));
+    if (first == nullptr) {
+      return nullptr;
+    }
+    NgxPoolCleanup *c = nullptr;
+    NgxPoolCleanupArray *a = nullptr;
+    if (!std::is_trivially_destructible<T>::value) {
+      c = ngxCleanupAdd(sizeof(NgxPoolCleanupArray));
+      if (c == nullptr) {
+        return nullptr;
+      }
+      a = (NgxPoolCleanupArray *)c->data_;
+    }
+    size_t i = 0;
+    try {
+      for (; i < n; ++i) {
+        new (first + i) T();
+      }
+    } catch (...) {
+      while (i > 0) {
+        first[--i].~T();
+      }
+      throw;
+    }
+    if (c) {
+      a->elts_ = first;
+      a->nelts_ = n;
+      c->handler_ = &destroyArray<T>;
+    }
+    return first;
+  }
+  //* 释放和重置时把大块内存按尺寸桶留在内存池中，之后的 ngxPallocLarge 直接复用，最多保留 maxBytes 字节
+  //* 开启后大块内存按所在桶的尺寸开辟(每翻一倍分 4 级，4KB 到 4MB)；0 表示关闭，调低时立即交还多出的部分
+  void ngxSetLargeCache(size_t maxBytes);
+  //* 不小于 bytes 的大块内存直接 mmap，释放时立即 munmap 交还操作系统，不进入缓存；0 表示关闭
+  void ngxSetMmapThreshold(size_t bytes);
+  size_t ngxTrimLargeCache();                         //* 交还尺寸桶缓存中的全部大块内存，返回字节数
+  //* 保存当前的分配位置；ngxRollback 把内存池恢复到该位置：逆序执行之后登记的清理，
+  //* 释放之后开辟的大块内存，小块内存的 last_、failed_ 和 current_ 恢复原值，之后追加的内存块清空留用
+  //* 保存点可以嵌套，须按后进先出的顺序回滚；ngxResetPool 后之前的保存点全部失效
+  //* 保存和回滚要求此时没有其他线程在使用内存池
+  NgxPoolMark ngxMark();
+  void ngxRollback(NgxPoolMark mark);
+  //* 以下三项在开始分配之前设置
+  //* 之后每个新内存块是上一个的两倍，直到 maxBlockSize；默认与第一个内存块相同，即不增长
+  void ngxSetBlockGrowth(size_t maxBlockSize);
+  //* 不超过 bytes 的申请从小块内存分配，默认取第一个内存块可用部分和 NGX_MAX_ALLOC_FROM_POOL 中的较小值
+  //* bytes 截断到最大内存块(见 ngxSetBlockGrowth，应先调用它)除去头部后的大小；超过当前内存块大小的小块申请会开辟足够大的新内存块
+  //* 只在构造后、第一次分配之前有效，之后调用被忽略，以免同一个申请在开辟和释放两侧按不同的 max 判断
+  void ngxSetMaxSmall(size_t bytes);
+  //* 内存块申请失败超过 limit 次后 current_ 越过它，默认 4；调小可让 ngxPallocSmall 少遍历已满的内存块
+  void ngxSetFailLimit(ngx_uint limit);
+  size_t ngxMaxSmall() const { return pool_->max_; }  //* 从小块内存分配的最大申请字节数
+  //* size 字节的申请是否来自大块内存，只有这些需要 ngxPfree；开辟和释放两侧都按它判断
+  bool ngxIsLarge(size_t size) const { return size > pool_->max_; }
 
 private:
+  //* ngxCreateArray 登记的清理数据
+  struct NgxPoolCleanupArray {
+    void            *elts_;      //* 数组首元素
+    size_t          nelts_;      //* 元素个数
+  };
+
+  template <typename T>
+  static void destroyObject(void *p) {
+    static_cast<T *>(p)->~T();
+  }
+
+  template <typename T>
+  static void destroyArray(void *p) {
+    NgxPoolCleanupArray *a = static_cast<NgxPoolCleanupArray *>(p);
+    for (size_t i = a->nelts_; i > 0; --i) {
+      static_cast<T *>(a->elts_)[i - 1].~T();
+    }
+  }
+
+  void runCleanups();                                 //* 按登记的逆序执行并清空所有清理记录
   void *ngxPallocSmall(size_t size, ngx_uint align); //* 小块内存分配
-  void *ngxPallocLarge(size_t size);                  //* 大块内存分配
+  void *ngxPallocLarge(size_t size, size_t align = 0);  //* 大块内存分配，align 超过 NGX_ALIGNMENT 时按它对齐
   void *ngxPallocBlock(size_t size);                  //* 分配新的小块内存池
+  size_t largeSlot(void *p) const;                    //* 大块内存地址在散列表中的初始槽位
+  size_t largeFind(void *p) const;                    //* 查找 p 所在的槽位，不存在时返回散列表大小
+  void largeInsert(NgxPoolLarge *large);              //* 登记大块内存，装载率超过一半时扩容
+  void largeErase(size_t slot);                       //* 删除槽位，后移删除，不留墓碑
+  static int largeBucket(size_t size);                //* size 所在的尺寸桶，超过 4MB 时返回 -1
+  static size_t largeBucketSize(int bucket);          //* 尺寸桶的字节数
+  bool largeCachePut(void *p, size_t size, PageSource *source);  //* 放入尺寸桶缓存，放不下返回 false
+  size_t largeCacheShrink(size_t limit);              //* 交还缓存中的大块内存直到不超过 limit 字节
+
+  static const int kLargeBuckets = 41;              //* 尺寸桶个数
 
   NgxPool *pool_;                   //* 指向 ngx 内存池入口的指针
+  PageSource *source_;              //* 小块内存块和大块内存的来源(malloc、mmap、透明大页)
+  size_t blockSize_;                //* 下一个新内存块的大小
+  size_t maxBlockSize_;             //* 内存块大小增长的上限
+  ngx_uint failLimit_ = 4;          //* current_ 越过内存块之前允许的失败次数
+  //* 大块内存地址到头部信息的开放寻址散列表，ngxPfree 不再遍历 large_ 链表
+  std::vector<NgxPoolLarge *> largeTable_;
+  size_t largeBits_ = 0;            //* 散列表大小为 2^largeBits_，空表为 0
+  size_t largeUsed_ = 0;            //* 散列表中登记的大块内存个数
+  size_t largeSerial_ = 0;          //* 下一个大块内存的序号
+  typename ThreadPolicy::Mutex largeMtx_;  //* 保护 large_、largeFree_、散列表和尺寸桶缓存
+  typename ThreadPolicy::Mutex chainMtx_;  //* 保护 chain_ 和 freeBufs_
+  void *largeBuckets_[kLargeBuckets] = {};  //* 尺寸桶缓存，空闲大块内存的第一个字存放下一块的地址
+  size_t largeCachedBytes_ = 0;     //* 尺寸桶缓存中的字节数
+  size_t largeCacheMax_ = 0;        //* 尺寸桶缓存的字节上限，0 表示不缓存
+  size_t mmapThreshold_ = 0;        //* mmap 阈值，0 表示不使用
+#if NGX_POOL_STATS
+  NgxPoolCounters counters_ = {};   //* 分配计数
+#endif
 };
 
+using NgxMemPool = NgxBasicMemPool<NgxSingleThread>;            //* 单线程内存池
+using NgxConcurrentMemPool = NgxBasicMemPool<NgxMultiThread>;   //* 可被多个线程同时分配的内存池
+
+//* 以 std::pmr::memory_resource 的形式使用 ngx 内存池，容器的开辟只是推进 last_
+//* 小块内存的释放什么也不做，随 ngxResetPool 或内存池析构一起释放；ngxIsLarge 的释放交给 ngxPfree
+//* 例：std::pmr::vector<int> v(&resource); 其中 NgxPoolResource<NgxMemPool> resource(pool);
+template <typename Pool>
+class NgxPoolResource : public std::pmr::memory_resource {
+public:
+  explicit NgxPoolResource(Pool &pool) : pool_(&pool) {}
+
+  Pool *pool() const { return pool_; }
+
+protected:
+  void *do_allocate(size_t bytes, size_t align) override {
+    void *p = pool_->ngxPallocAligned(bytes == 0 ? 1 : bytes, align);
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  void do_deallocate(void *p, size_t bytes, size_t) override {
+    if (pool_->ngxIsLarge(bytes == 0 ? 1 : bytes)) {
+      pool_->ngxPfree(p);
+    }
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    const NgxPoolResource *r = dynamic_cast<const NgxPoolResource *>(&other);
+    return r && r->pool_ == pool_;
+  }
+
+private:
+  Pool *pool_;
+};
+
+//* 从 ngx 内存池开辟的 STL 分配器，可 rebind，释放规则与 NgxPoolResource 相同
+//* 例：std::vector<int, NgxPoolAllocator<int>> v(NgxPoolAllocator<int>(pool));
+template <typename T, typename Pool = NgxMemPool>
+class NgxPoolAllocator {
+public:
+  using value_type = T;
 
+  explicit NgxPoolAllocator(Pool &pool) noexcept : pool_(&pool) {}
+  template <typename U>
+  NgxPoolAllocator(const NgxPoolAllocator<U, Pool> &other) noexcept : pool_(other.pool()) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t)-1 / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    void *p = pool_->ngxPallocAligned(n == 0 ? 1 : n * sizeof(T), alignof(T));
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t n) noexcept {
+    if (pool_->ngxIsLarge(n == 0 ? 1 : n * sizeof(T))) {
+      pool_->ngxPfree(p);
+    }
+  }
+
+  Pool *pool() const noexcept { return pool_; }
+
+private:
+  Pool *pool_;
+};
+
+//* 使用同一个内存池的两个分配器可以互相释放对方开辟的内存
+template <typename T, typename U, typename Pool>
+bool operator==(const NgxPoolAllocator<T, Pool> &a, const NgxPoolAllocator<U, Pool> &b) noexcept {
+  return a.pool() == b.pool();
+}
+
+template <typename T, typename U, typename Pool>
+bool operator!=(const NgxPoolAllocator<T, Pool> &a, const NgxPoolAllocator<U, Pool> &b) noexcept {
+  return a.pool() != b.pool();
+}
+
+//* 作用域守卫：构造时保存，析构时回滚，作用域内分配的临时数据随之释放
+//* 需要保留作用域内的分配时调用 dismiss
+template <typename Pool>
+class NgxPoolScope {
+public:
+  explicit NgxPoolScope(Pool &pool) : pool_(pool), mark_(pool.ngxMark()) {}
+  ~NgxPoolScope() {
+    if (mark_) {
+      pool_.ngxRollback(mark_);
+    }
+  }
+  NgxPoolScope(const NgxPoolScope &) = delete;
+  NgxPoolScope &operator=(const NgxPoolScope &) = delete;
+
+  void dismiss() { mark_ = nullptr; }
+
+private:
+  Pool &pool_;
+  NgxPoolMark mark_;
+};
 
 #endif
\ No newline at end of file
@@ -0,0 +1,337 @@
+#include "ngx_slab.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void *ngxShmAlloc(const char *name, size_t size, bool create) {
+  void *p;
+  if (name == nullptr) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  //* 创建时要求同名对象不存在：截断一个其他进程仍在映射的对象会抹掉它们的数据，之后访问还会 SIGBUS
+  //* 创建失败说明名字已被占用(errno 为 EEXIST)，上一次运行崩溃后残留的对象由调用者确认无人使用后 shm_unlink
+  int fd = shm_open(name, create ? O_RDWR | O_CREAT | O_EXCL : O_RDWR, 0600);
+  if (fd == -1) {
+    return nullptr;
+  }
+  if (create && ftruncate(fd, (off_t)size) == -1) {
+    close(fd);
+    shm_unlink(name);
+    return nullptr;
+  }
+  p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  return p == MAP_FAILED ? nullptr : p;
+}
+
+void ngxShmFree(void *addr, size_t size, const char *name) {
+  munmap(addr, size);
+  if (name) {
+    shm_unlink(name);
+  }
+}
+
+//* 尺寸类别 shift 每页的对象数
+static inline uint32_t ngxSlabObjects(unsigned shift) {
+  return (uint32_t)(NGX_SLAB_PAGE_SIZE >> shift);
+}
+
+//* SMALL 页首的位图占用的对象数
+static inline uint32_t ngxSlabReserved(unsigned shift) {
+  uint32_t n = ngxSlabObjects(shift);
+  if (n <= 64) {
+    return 0;
+  }
+  return (uint32_t)((n / 8 + ((size_t)1 << shift) - 1) >> shift);
+}
+
+NgxSlabPool *NgxSlabPool::ngxSlabInit(void *addr, size_t size) {
+  NgxSlabPool *pool = (NgxSlabPool *)addr;
+  size_t pagesOff = ngxAlign(sizeof(NgxSlabPool), alignof(NgxSlabPage));
+  if (size < pagesOff) {
+    return nullptr;
+  }
+
+  //* 页描述符和数据页一一对应，数据页的起始偏移按页对齐
+  size_t n = (size - pagesOff) / (NGX_SLAB_PAGE_SIZE + sizeof(NgxSlabPage));
+  while (n > 0 && ngxAlign(pagesOff + n * sizeof(NgxSlabPage), NGX_SLAB_PAGE_SIZE) + (n << NGX_SLAB_PAGE_SHIFT) > size) {
+    --n;
+  }
+  if (n == 0 || n > UINT32_MAX - 1) {
+    return nullptr;
+  }
+
+  memset((void *)pool, 0, pagesOff + n * sizeof(NgxSlabPage));
+  pool->pagesOff_ = pagesOff;
+  pool->dataOff_ = ngxAlign(pagesOff + n * sizeof(NgxSlabPage), NGX_SLAB_PAGE_SIZE);
+  pool->npages_ = (uint32_t)n;
+
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  int rc = pthread_mutex_init(&pool->mutex_, &attr);
+  pthread_mutexattr_destroy(&attr);
+  if (rc != 0) {
+    return nullptr;
+  }
+
+  //* 开始时所有数据页是一个空闲页段
+  pool->setFreeRun(0, pool->npages_);
+  pool->pfree_ = pool->npages_;
+  return pool;
+}
+
+void NgxSlabPool::ngxSlabLock() {
+  //* 持锁的进程崩溃后锁转给下一个加锁者，分配器的状态仍按原样继续使用
+  if (pthread_mutex_lock(&mutex_) == EOWNERDEAD) {
+    pthread_mutex_consistent(&mutex_);
+  }
+}
+
+void NgxSlabPool::ngxSlabUnlock() {
+  pthread_mutex_unlock(&mutex_);
+}
+
+void *NgxSlabPool::ngxSlabAlloc(size_t size) {
+  ngxSlabLock();
+  void *p = ngxSlabAllocLocked(size);
+  ngxSlabUnlock();
+  return p;
+}
+
+void *NgxSlabPool::ngxSlabCalloc(size_t size) {
+  void *p = ngxSlabAlloc(size);
+  if (p) {
+    memset(p, 0, size);
+  }
+  return p;
+}
+
+void NgxSlabPool::ngxSlabFree(void *p) {
+  ngxSlabLock();
+  ngxSlabFreeLocked(p);
+  ngxSlabUnlock();
+}
+
+void *NgxSlabPool::ngxSlabAllocLocked(size_t size) {
+  //* 超过半页按整页开辟
+  if (size > NGX_SLAB_PAGE_SIZE / 2) {
+    //* 分开计算整页数和零头，size 接近 SIZE_MAX 时 size + NGX_SLAB_PAGE_SIZE - 1 会回绕成很小的页数
+    size_t n = (size >> NGX_SLAB_PAGE_SHIFT) + ((size & (NGX_SLAB_PAGE_SIZE - 1)) != 0);
+    if (n == 0 || n > npages_) {
+      return nullptr;
+    }
+    uint32_t i = allocPages((uint32_t)n);
+    return i == npages_ ? nullptr : data(i);
+  }
+
+  unsigned shift = NGX_SLAB_MIN_SHIFT;
+  while (((size_t)1 << shift) < size) {
+    ++shift;
+  }
+  return allocObject(shift);
+}
+
+void *NgxSlabPool::allocObject(unsigned shift) {
+  uint32_t *slot = &slots_[shift - NGX_SLAB_MIN_SHIFT];
+  NgxSlabStat *stat = &stats_[shift - NGX_SLAB_MIN_SHIFT];
+  uint32_t n = ngxSlabObjects(shift);
+  uint32_t i;
+
+  ++stat->reqs_;
+  if (*slot == 0) {
+    //* 没有半满的页，开辟一页并初始化位图
+    i = allocPages(1);
+    if (i == npages_) {
+      ++stat->fails_;
+      return nullptr;
+    }
+    NgxSlabPage *pg = page(i);
+    uint32_t reserved = ngxSlabReserved(shift);
+    pg->shift_ = (uint8_t)shift;
+    pg->slab_ = 0;
+    pg->used_ = (uint16_t)reserved;
+    if (n > 64) {
+      pg->kind_ = kSmall;
+      uint64_t *bitmap = (uint64_t *)data(i);
+      memset(bitmap, 0, n / 8);
+      for (uint32_t b = 0; b < reserved; ++b) {
+        bitmap[b / 64] |= (uint64_t)1 << (b % 64);
+      }
+    } else {
+      pg->kind_ = kExact;
+    }
+    stat->total_ += n - reserved;
+    listPush(slot, i);
+  }
+
+  i = *slot - 1;
+  NgxSlabPage *pg = page(i);
+  uint32_t obj;
+  if (pg->kind_ == kSmall) {
+    uint64_t *bitmap = (uint64_t *)data(i);
+    uint32_t w = 0;
+    while (bitmap[w] == ~(uint64_t)0) {
+      ++w;
+    }
+    uint32_t b = (uint32_t)__builtin_ctzll(~bitmap[w]);
+    bitmap[w] |= (uint64_t)1 << b;
+    obj = w * 64 + b;
+  } else {
+    obj = (uint32_t)__builtin_ctzll(~pg->slab_);
+    pg->slab_ |= (uint64_t)1 << obj;
+  }
+
+  //* 页写满后移出半满页链表
+  if (++pg->used_ == n) {
+    listRemove(slot, i);
+  }
+  ++stat->used_;
+  return data(i) + ((size_t)obj << shift);
+}
+
+void NgxSlabPool::ngxSlabFreeLocked(void *p) {
+  u_char *start = data(0);
+  if ((u_char *)p < start || (u_char *)p >= data(npages_)) {
+    return;
+  }
+  size_t off = (size_t)((u_char *)p - start);
+  uint32_t i = (uint32_t)(off >> NGX_SLAB_PAGE_SHIFT);
+  NgxSlabPage *pg = page(i);
+
+  if (pg->kind_ == kPage) {
+    if ((off & (NGX_SLAB_PAGE_SIZE - 1)) == 0) {
+      freePages(i, (uint32_t)pg->slab_);
+    }
+    return;
+  }
+  if (pg->kind_ != kSmall && pg->kind_ != kExact) {
+    return;
+  }
+
+  unsigned shift = pg->shift_;
+  uint32_t n = ngxSlabObjects(shift);
+  uint32_t reserved = ngxSlabReserved(shift);
+  uint32_t obj = (uint32_t)((off & (NGX_SLAB_PAGE_SIZE - 1)) >> shift);
+  uint64_t bit = (uint64_t)1 << (obj % 64);
+  uint64_t *word = pg->kind_ == kSmall ? (uint64_t *)data(i) + obj / 64 : &pg->slab_;
+  //* 不是对象的起始地址、位图本身或者已经释放过
+  if ((off & (((size_t)1 << shift) - 1)) != 0 || obj < reserved || !(*word & bit)) {
+    return;
+  }
+  *word &= ~bit;
+
+  uint32_t *slot = &slots_[shift - NGX_SLAB_MIN_SHIFT];
+  NgxSlabStat *stat = &stats_[shift - NGX_SLAB_MIN_SHIFT];
+  bool full = pg->used_ == n;
+  --pg->used_;
+  --stat->used_;
+  if (pg->used_ == reserved) {
+    //* 整页空闲，交还空闲页
+    if (!full) {
+      listRemove(slot, i);
+    }
+    stat->total_ -= n - reserved;
+    freePages(i, 1);
+  } else if (full) {
+    listPush(slot, i);
+  }
+}
+
+void NgxSlabPool::listPush(uint32_t *head, uint32_t i) {
+  NgxSlabPage *pg = page(i);
+  pg->prev_ = 0;
+  pg->next_ = *head;
+  if (*head) {
+    page(*head - 1)->prev_ = i + 1;
+  }
+  *head = i + 1;
+}
+
+void NgxSlabPool::listRemove(uint32_t *head, uint32_t i) {
+  NgxSlabPage *pg = page(i);
+  if (pg->prev_) {
+    page(pg->prev_ - 1)->next_ = pg->next_;
+  } else {
+    *head = pg->next_;
+  }
+  if (pg->next_) {
+    page(pg->next_ - 1)->prev_ = pg->prev_;
+  }
+}
+
+void NgxSlabPool::setFreeRun(uint32_t i, uint32_t n) {
+  NgxSlabPage *pg = page(i);
+  pg->kind_ = kFree;
+  pg->slab_ = n;
+  if (n > 1) {
+    NgxSlabPage *tail = page(i + n - 1);
+    tail->kind_ = kFreeTail;
+    tail->head_ = i;
+  }
+  listPush(&free_, i);
+}
+
+uint32_t NgxSlabPool::allocPages(uint32_t n) {
+  for (uint32_t j = free_; j; j = page(j - 1)->next_) {
+    uint32_t i = j - 1;
+    NgxSlabPage *pg = page(i);
+    uint32_t len = (uint32_t)pg->slab_;
+    if (len < n) {
+      continue;
+    }
+    //* 从页段头部切下 n 页，剩余部分作为新的空闲页段
+    listRemove(&free_, i);
+    if (len > n) {
+      setFreeRun(i + n, len - n);
+    }
+    pg->kind_ = kPage;
+    pg->slab_ = n;
+    if (n > 1) {
+      NgxSlabPage *tail = page(i + n - 1);
+      tail->kind_ = kBusy;
+      tail->head_ = i;
+    }
+    pfree_ -= n;
+    return i;
+  }
+  return npages_;
+}
+
+void NgxSlabPool::freePages(uint32_t i, uint32_t n) {
+  pfree_ += n;
+  //* 先标记为空闲，重复释放同一地址时不会再次进入这里
+  page(i)->kind_ = kFree;
+  if (n > 1) {
+    page(i + n - 1)->kind_ = kFreeTail;
+  }
+
+  //* 与后面的空闲页段合并，i + n 总是某个页段的首页
+  if (i + n < npages_ && page(i + n)->kind_ == kFree) {
+    uint32_t next = i + n;
+    listRemove(&free_, next);
+    n += (uint32_t)page(next)->slab_;
+  }
+  //* 与前面的空闲页段合并，i - 1 总是某个页段的末页
+  if (i > 0) {
+    NgxSlabPage *prev = page(i - 1);
+    uint32_t head = npages_;
+    if (prev->kind_ == kFree) {
+      head = i - 1;
+    } else if (prev->kind_ == kFreeTail) {
+      head = prev->head_;
+    }
+    if (head != npages_) {
+      listRemove(&free_, head);
+      n += (uint32_t)page(head)->slab_;
+      i = head;
+    }
+  }
+  setFreeRun(i, n);
+}
@@ -0,0 +1,104 @@
+#ifndef NGX_SLAB_H
+#define NGX_SLAB_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ngx_mem_pool.hpp"
+
+#ifndef NGX_SLAB_PAGE_SHIFT
+#define NGX_SLAB_PAGE_SHIFT 12  //* slab 页大小为 1 << NGX_SLAB_PAGE_SHIFT 字节
+#endif
+#define NGX_SLAB_PAGE_SIZE ((size_t)1 << NGX_SLAB_PAGE_SHIFT)
+#define NGX_SLAB_MIN_SHIFT 3    //* 最小的尺寸类别为 8 字节
+
+//* 共享内存：name 为空时 mmap(MAP_SHARED | MAP_ANONYMOUS)，之后 fork 出的 worker 继承同一块内存；
+//* 否则 shm_open 创建(create 为 true)或打开同名的共享内存，不同进程映射到的地址可能不同
+//* 创建时同名对象已存在则失败(O_EXCL，errno 为 EEXIST)，不会截断其他进程正在使用的共享内存
+//* 失败返回 nullptr
+void *ngxShmAlloc(const char *name, size_t size, bool create);
+//* 解除映射；name 不为空时同时 shm_unlink，已经打开的进程不受影响
+void ngxShmFree(void *addr, size_t size, const char *name);
+
+//* 页描述符，与数据页一一对应，链表用页下标(加 1，0 表示空)串接，不保存指针
+struct NgxSlabPage {
+  uint64_t          slab_;       //* 空闲页和多页分配的首页：连续的页数；EXACT 页：对象位图
+  uint32_t          next_;       //* 空闲页链表或尺寸类别的半满页链表
+  uint32_t          prev_;
+  uint32_t          head_;       //* 空闲页段和多页分配的末页：首页的下标
+  uint16_t          used_;       //* SMALL/EXACT 页已分配的对象数，包括存放位图的对象
+  uint8_t           kind_;       //* 页的用途，见 NgxSlabPool::Kind
+  uint8_t           shift_;      //* SMALL/EXACT 页的尺寸类别
+};
+
+//* 每个尺寸类别的统计
+struct NgxSlabStat {
+  size_t            total_;      //* 该类别的页中可分配的对象数
+  size_t            used_;       //* 已分配的对象数
+  size_t            reqs_;       //* 分配请求数
+  size_t            fails_;      //* 分配失败数
+};
+
+//* 共享内存上的 slab 分配器，对应 nginx 的 ngx_slab_pool_t
+//* 放在共享内存的起始处，之后依次是页描述符数组和按页对齐的数据页；内部只保存相对起始地址的偏移和页下标，
+//* 各进程把同一块共享内存映射到不同地址也能使用
+//* 不超过半页的申请按 2 的幂分成尺寸类别，同一页中的对象用位图记录：
+//*   每页对象超过 64 个的类别(SMALL)，位图放在页首，占用开头几个对象；其余类别(EXACT)，位图放在页描述符中
+//* 超过半页的申请按整页开辟；释放对象是 O(1) 的，页中的对象全部释放后整页交还空闲页，相邻的空闲页合并
+//* 多个进程之间用进程间共享的健壮互斥锁同步，持锁的进程崩溃后其他进程仍能继续加锁
+class NgxSlabPool {
+public:
+  //* 在 [addr, addr + size) 上建立 slab 分配器，addr 须按页对齐(mmap 返回的地址即可)
+  //* 只由创建共享内存的进程调用一次，其他进程直接把映射地址转换为 NgxSlabPool * 使用
+  static NgxSlabPool *ngxSlabInit(void *addr, size_t size);
+
+  void *ngxSlabAlloc(size_t size);          //* 加锁开辟，失败返回 nullptr
+  void *ngxSlabCalloc(size_t size);         //* 加锁开辟并清零
+  void ngxSlabFree(void *p);                //* 加锁释放，p 不属于本分配器或已释放时什么也不做
+  void *ngxSlabAllocLocked(size_t size);    //* 调用者已经持有锁
+  void ngxSlabFreeLocked(void *p);
+
+  void ngxSlabLock();
+  void ngxSlabUnlock();
+
+  //* 共享内存中的数据结构保存偏移，各进程用自己的映射地址还原；nullptr 对应偏移 0
+  size_t ngxSlabOffset(const void *p) const { return p ? (size_t)((const u_char *)p - (const u_char *)this) : 0; }
+  void *ngxSlabAddr(size_t offset) const { return offset ? (u_char *)this + offset : nullptr; }
+
+  size_t ngxSlabPages() const { return npages_; }     //* 数据页总数
+  size_t ngxSlabFreePages() const { return pfree_; }  //* 空闲数据页数
+  //* 尺寸类别 shift(NGX_SLAB_MIN_SHIFT 到 NGX_SLAB_PAGE_SHIFT - 1) 的统计
+  NgxSlabStat ngxSlabStat(unsigned shift) const { return stats_[shift - NGX_SLAB_MIN_SHIFT]; }
+
+private:
+  enum { kSlots = NGX_SLAB_PAGE_SHIFT - 1 - NGX_SLAB_MIN_SHIFT + 1 };
+  enum Kind : uint8_t {
+    kFree = 0,                   //* 空闲页段的首页
+    kFreeTail,                   //* 空闲页段的末页
+    kPage,                       //* 多页分配的首页
+    kBusy,                       //* 多页分配的末页
+    kSmall,                      //* 位图在页首的小对象页
+    kExact,                      //* 位图在页描述符中的对象页
+  };
+
+  NgxSlabPage *page(uint32_t i) { return pages() + i; }
+  NgxSlabPage *pages() { return (NgxSlabPage *)((u_char *)this + pagesOff_); }
+  u_char *data(uint32_t i) { return (u_char *)this + dataOff_ + ((size_t)i << NGX_SLAB_PAGE_SHIFT); }
+  void listRemove(uint32_t *head, uint32_t i);
+  void listPush(uint32_t *head, uint32_t i);
+  uint32_t allocPages(uint32_t n);          //* 首次适配开辟 n 个连续页，返回首页下标，失败返回 npages_
+  void freePages(uint32_t i, uint32_t n);   //* 交还页段并与相邻的空闲页段合并
+  void setFreeRun(uint32_t i, uint32_t n);
+  void *allocObject(unsigned shift);
+
+  pthread_mutex_t   mutex_;      //* PTHREAD_PROCESS_SHARED | PTHREAD_MUTEX_ROBUST
+  size_t            pagesOff_;   //* 页描述符数组相对起始地址的偏移
+  size_t            dataOff_;    //* 第一个数据页相对起始地址的偏移，按页对齐
+  uint32_t          npages_;
+  uint32_t          pfree_;
+  uint32_t          free_;       //* 空闲页段链表
+  uint32_t          slots_[kSlots];  //* 各尺寸类别还有空闲对象的页链表
+  NgxSlabStat       stats_[kSlots];
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef PAGE_SOURCE_H
+#define PAGE_SOURCE_H
+
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//* 内存池向系统申请底层内存的统一接口，sgi_stl::Allocator 的 chunk 和 NgxMemPool 的内存块、大块内存都经由它开辟
+class PageSource {
+public:
+  virtual ~PageSource() {}
+
+  //* 开辟 size 字节的内存，起始地址至少按 16 字节对齐，失败返回 nullptr
+  virtual void *allocate(size_t size) = 0;
+  //* 归还 allocate 开辟的内存，size 须与开辟时一致
+  virtual void deallocate(void *p, size_t size) = 0;
+  //* 开辟粒度，调用者可将申请的字节数上调到它的整数倍，避免末尾的零头浪费
+  virtual size_t granularity() const { return 16; }
+
+  //* 交还 [p, p + size) 中完整的物理页，内存仍然可以访问，再次访问时内容为 0
+  virtual void release(void *p, size_t size) {
+    size_t page = pageSize();
+    char *first = (char *)(((size_t)p + page - 1) & ~(page - 1));
+    char *last = (char *)(((size_t)p + size) & ~(page - 1));
+    if (first < last) {
+      madvise(first, last - first, MADV_DONTNEED);
+    }
+  }
+
+  static size_t pageSize() {
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return page;
+  }
+};
+
+//* 直接使用 malloc/free，与 glibc 堆共用内存
+class MallocPageSource : public PageSource {
+public:
+  void *allocate(size_t size) override { return malloc(size); }
+  void deallocate(void *p, size_t /* size */) override { free(p); }
+};
+
+//* 匿名 mmap，按页开辟，与 glibc 堆相互独立，归还时直接 munmap 给操作系统
+class MmapPageSource : public PageSource {
+public:
+  void *allocate(size_t size) override {
+    void *p = mmap(nullptr, roundUp(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+  void deallocate(void *p, size_t size) override { munmap(p, roundUp(size)); }
+  size_t granularity() const override { return pageSize(); }
+
+private:
+  static size_t roundUp(size_t size) { return (size + pageSize() - 1) & ~(pageSize() - 1); }
+};
+
+//* 按 2MB 对齐的匿名 mmap，并通过 madvise(MADV_HUGEPAGE) 请求透明大页，大内存池可显著减少 TLB miss
+class HugePageSource : public PageSource {
+public:
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  void *allocate(size_t size) override {
+    size = roundUp(size);
+    //* 多映射一个大页，再把首尾不对齐的部分解除映射，得到 2MB 对齐的区域
+    char *raw = (char *)mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (char *)MAP_FAILED) {
+      return nullptr;
+    }
+    char *p = (char *)(((size_t)raw + kHugePageSize - 1) & ~(kHugePageSize - 1));
+    if (p > raw) {
+      munmap(raw, p - raw);
+    }
+    if (p + size < raw + size + kHugePageSize) {
+      munmap(p + size, raw + size + kHugePageSize - (p + size));
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+  void deallocate(void *p, size_t size) override { munmap(p, roundUp(size)); }
+  size_t granularity() const override { return kHugePageSize; }
+
+private:
+  static size_t roundUp(size_t size) { return (size + kHugePageSize - 1) & ~(kHugePageSize - 1); }
+};
+
+//* 三种来源各自的进程级单例，有意不析构，保证其他静态对象析构时仍可归还内存
+inline PageSource *mallocPageSource() {
+  static PageSource *source = new MallocPageSource();
+  return source;
+}
+
+inline PageSource *mmapPageSource() {
+  static PageSource *source = new MmapPageSource();
+  return source;
+}
+
+inline PageSource *hugePageSource() {
+  static PageSource *source = new HugePageSource();
+  return source;
+}
+
+#endif
@@ -0,0 +1,340 @@
+//* 以 sgi_stl 自由链表内存池替换 malloc/free，编译为共享库后通过 LD_PRELOAD 注入未修改的程序：
+//*   LD_PRELOAD=lib/libsgi_stl_malloc.so ./a.out
+//* 每个尺寸类别独占一个 __pool_engine，该实例的 chunk 只切分这一个类别的节点，
+//* 因此一页内存只属于一个类别，free(p) 时查页表即可得到尺寸，节点不需要头部
+//* 超过最大类别的大块内存直接 mmap，首页在页表中记录页数
+//* 不使用线程缓存：glibc 登记线程局部对象析构函数时本身会调用 calloc，线程缓存的初始化会重入 malloc
+#include "sgi_stl_mem_pool.hpp"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <new>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+namespace sgi_stl {
+
+//* 64 字节以内按 8 字节递增，之后每翻一倍分四级，直到 32KB
+typedef __size_class<32768, 64, 4> __malloc_size_class;
+typedef __pool_engine<__malloc_size_class> __malloc_engine;
+
+//* 页号到尺寸类别的两级映射，覆盖 48 位用户态地址空间
+//* 表项为 0 表示不是本库开辟的内存；小块内存页记录类别下标加一；大块内存首页记录 _LARGE 与页数
+class __page_map {
+public:
+  enum { _PAGE_SHIFT = 12, _LEAF_BITS = 18, _ROOT_BITS = 48 - _PAGE_SHIFT - _LEAF_BITS };
+  enum : uint32_t { _LARGE = 0x80000000u };
+
+  static uint32_t _S_get(const void *__p) {
+    long unsigned int __page = (long unsigned int)__p >> _PAGE_SHIFT;
+    if (__page >> (_ROOT_BITS + _LEAF_BITS)) return 0;
+    uint32_t *__leaf = _S_root[__page >> _LEAF_BITS].load(std::memory_order_acquire);
+    return __leaf == nullptr ? 0 : __atomic_load_n(&__leaf[__page & ((1UL << _LEAF_BITS) - 1)], __ATOMIC_RELAXED);
+  }
+
+  //* 将 [__p, __p + __bytes) 覆盖的每一页记为 __value，叶子开辟失败时返回 false
+  static bool _S_set_range(const void *__p, long unsigned int __bytes, uint32_t __value) {
+    long unsigned int __first = (long unsigned int)__p >> _PAGE_SHIFT;
+    long unsigned int __last = ((long unsigned int)__p + __bytes - 1) >> _PAGE_SHIFT;
+    for (long unsigned int __page = __first; __page <= __last; ++__page) {
+      if (!_S_set(__page, __value)) return false;
+    }
+    return true;
+  }
+
+  static bool _S_set(long unsigned int __page, uint32_t __value) {
+    std::atomic<uint32_t *> &__slot = _S_root[__page >> _LEAF_BITS];
+    uint32_t *__leaf = __slot.load(std::memory_order_acquire);
+    if (__leaf == nullptr) {
+      //* 叶子不存在时其中的表项都是 0，清除不需要开辟
+      if (__value == 0) return true;
+      //* 叶子按需 mmap，内容全为 0；多个线程同时创建时只保留一个
+      void *__fresh = mmap(nullptr, sizeof(uint32_t) << _LEAF_BITS, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (__fresh == MAP_FAILED) return false;
+      if (__slot.compare_exchange_strong(__leaf, (uint32_t *)__fresh, std::memory_order_acq_rel)) {
+        __leaf = (uint32_t *)__fresh;
+      } else {
+        munmap(__fresh, sizeof(uint32_t) << _LEAF_BITS);
+      }
+    }
+    __atomic_store_n(&__leaf[__page & ((1UL << _LEAF_BITS) - 1)], __value, __ATOMIC_RELAXED);
+    return true;
+  }
+
+private:
+  static std::atomic<uint32_t *> _S_root[1UL << _ROOT_BITS];
+};
+
+std::atomic<uint32_t *> __page_map::_S_root[1UL << __page_map::_ROOT_BITS];
+
+//* 某个尺寸类别的 chunk 来源：匿名 mmap，并把 chunk 的每一页登记为该类别
+class __class_page_source : public MmapPageSource {
+public:
+  explicit __class_page_source(uint32_t __class) : _M_class(__class) {}
+
+  //* mmap 或页表叶子开辟失败时返回空，所属实例设置了 _M_can_fail，不会改用 malloc 开辟 chunk
+  void *allocate(size_t __size) override {
+    void *__p = MmapPageSource::allocate(__size);
+    if (__p == nullptr) return nullptr;
+    if (!__page_map::_S_set_range(__p, __size, _M_class + 1)) {
+      __page_map::_S_set_range(__p, __size, 0);
+      MmapPageSource::deallocate(__p, __size);
+      return nullptr;
+    }
+    return __p;
+  }
+
+  void deallocate(void *__p, size_t __size) override {
+    __page_map::_S_set_range(__p, __size, 0);
+    MmapPageSource::deallocate(__p, __size);
+  }
+
+private:
+  uint32_t _M_class;
+};
+
+//* 全部状态在第一次调用时构造在静态缓冲区中，从不析构：
+//* 其他共享库的构造函数可能早于本库的静态初始化调用 malloc，进程退出时也仍会调用 free
+class __malloc_state {
+public:
+  enum { _NCLASSES = __malloc_size_class::_S_nclasses };
+  enum { _MAX_BYTES = __malloc_size_class::_S_max_bytes };
+  enum { _MAX_ALIGN = 4096 };
+
+  static __malloc_state &_S_instance() {
+    alignas(__malloc_state) static unsigned char __storage[sizeof(__malloc_state)];
+    static __malloc_state *__state = new (__storage) __malloc_state();
+    return *__state;
+  }
+
+  void *_M_malloc(size_t __n) {
+    if (__n == 0) __n = 1;
+    if (__n > (size_t) _MAX_BYTES) return _S_large_allocate(__n, PageSource::pageSize());
+    long unsigned int __index = __malloc_size_class::_S_index(__n);
+    return _M_class_allocate(__index);
+  }
+
+  void _M_free(void *__p) {
+    if (__p == nullptr) return;
+    uint32_t __entry = __page_map::_S_get(__p);
+    //* 不是本库开辟的内存(例如注入之前由动态链接器开辟的)，无法得知大小，只能忽略
+    if (__entry == 0) return;
+    if (__entry & __page_map::_LARGE) {
+      _S_large_deallocate(__p, __entry);
+      return;
+    }
+    _M_engines[__entry - 1]._M_deallocate(__p, __entry - 1);
+  }
+
+  //* __p 可用的字节数，即所在类别的尺寸或大块内存的页数
+  static size_t _S_usable_size(const void *__p) {
+    if (__p == nullptr) return 0;
+    uint32_t __entry = __page_map::_S_get(__p);
+    if (__entry == 0) return 0;
+    if (__entry & __page_map::_LARGE) return (size_t)(__entry & ~__page_map::_LARGE) * PageSource::pageSize();
+    return __malloc_size_class::_S_size(__entry - 1);
+  }
+
+  //* 不需要调用者提供旧尺寸：旧尺寸由页表得到，新旧尺寸落在同一类别时原地返回
+  void *_M_realloc(void *__p, size_t __n) {
+    if (__p == nullptr) return _M_malloc(__n);
+    if (__n == 0) {
+      _M_free(__p);
+      return nullptr;
+    }
+    size_t __old = _S_usable_size(__p);
+    //* 不是本库开辟的内存(注入之前由原来的分配器开辟)，交给原来的 realloc
+    if (__old == 0) return _S_next_realloc(__p, __n);
+    if (__n <= __old && __n > __old / 2) return __p;
+    //* 开辟失败时 errno 已经置为 ENOMEM，原内存保持不变
+    void *__result = _M_malloc(__n);
+    if (__result == nullptr) return nullptr;
+    memcpy(__result, __p, __n < __old ? __n : __old);
+    _M_free(__p);
+    return __result;
+  }
+
+  static void *_S_next_realloc(void *__p, size_t __n) {
+    typedef void *(*__realloc_fn)(void *, size_t);
+    static __realloc_fn __next = (__realloc_fn)dlsym(RTLD_NEXT, "realloc");
+    if (__next == nullptr) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    return __next(__p, __n);
+  }
+
+  //* __align 为 2 的幂；选择尺寸是 __align 倍数的类别，该类别的节点都按其尺寸的最大 2 的幂因子对齐
+  void *_M_memalign(size_t __align, size_t __n) {
+    if (__align <= (size_t) __malloc_engine::_ALIGN) return _M_malloc(__n);
+    if (__n == 0) __n = 1;
+    if (__align <= (size_t) _MAX_ALIGN && __n <= (size_t) _MAX_BYTES) {
+      long unsigned int __index = __malloc_size_class::_S_index(__n);
+      while (__index < (long unsigned int) _NCLASSES && __malloc_size_class::_S_size(__index) % __align != 0) ++__index;
+      if (__index < (long unsigned int) _NCLASSES) return _M_class_allocate(__index);
+    }
+    return _S_large_allocate(__n, __align);
+  }
+
+  //* fork 前锁住所有类别，子进程中不会留下被其他线程持有的锁
+  //* 在库的构造函数中登记，而不是在首次 malloc 时：登记本身可能调用 malloc
+  static void _S_register_atfork() {
+    pthread_atfork([] { _S_instance()._M_lock_all(); },
+                   [] { _S_instance()._M_unlock_all(); },
+                   [] { _S_instance()._M_unlock_all(); });
+  }
+
+  void _M_lock_all() {
+    for (__malloc_engine &__engine : _M_engines) __engine.mtx.lock();
+  }
+
+  void _M_unlock_all() {
+    for (__malloc_engine &__engine : _M_engines) __engine.mtx.unlock();
+  }
+
+private:
+  //* 从第 __index 个类别开辟一个节点，chunk 开辟失败时置 errno 并返回空
+  void *_M_class_allocate(long unsigned int __index) {
+    void *__p = _M_engines[__index]._M_allocate(__index);
+    if (__p == nullptr) errno = ENOMEM;
+    return __p;
+  }
+
+  __malloc_state() {
+    for (int __i = 0; __i < _NCLASSES; ++__i) {
+      long unsigned int __size = __malloc_size_class::_S_size(__i);
+      //* 节点按类别尺寸的最大 2 的幂因子对齐，memalign 据此选择类别
+      long unsigned int __align = __size & -__size;
+      _M_engines[__i]._M_align = (unsigned int)(__align > (long unsigned int) _MAX_ALIGN ? (long unsigned int) _MAX_ALIGN : __align);
+      //* 每个实例只开辟一个类别，切分剩余的零头放进其他类别的链表后再也不会被取用
+      _M_engines[__i]._M_single_class = true;
+      //* malloc 开辟的 chunk 不在页表中，其中的节点释放时无法识别，内存来源失败时直接返回空
+      _M_engines[__i]._M_can_fail = true;
+      _M_engines[__i]._M_page_source = new (&_M_sources[__i]) __class_page_source(__i);
+    }
+  }
+
+  //* 大块内存直接 mmap，__align 超过页大小时多映射一段再裁掉首尾
+  static void *_S_large_allocate(size_t __n, size_t __align) {
+    size_t __page = PageSource::pageSize();
+    size_t __bytes = (__n + __page - 1) & ~(__page - 1);
+    if (__bytes < __n || __bytes / __page >= (size_t) __page_map::_LARGE) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    size_t __slack = __align > __page ? __align : 0;
+    char *__raw = (char *)mmap(nullptr, __bytes + __slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (__raw == (char *)MAP_FAILED) {
+      errno = ENOMEM;
+      return nullptr;
+    }
+    char *__p = __raw;
+    if (__slack > 0) {
+      __p = (char *)(((size_t)__raw + __align - 1) & ~(__align - 1));
+      if (__p > __raw) munmap(__raw, __p - __raw);
+      if (__raw + __bytes + __slack > __p + __bytes) munmap(__p + __bytes, __raw + __bytes + __slack - (__p + __bytes));
+    }
+    if (!__page_map::_S_set((size_t)__p >> __page_map::_PAGE_SHIFT, __page_map::_LARGE | (uint32_t)(__bytes / __page))) {
+      munmap(__p, __bytes);
+      errno = ENOMEM;
+      return nullptr;
+    }
+    return __p;
+  }
+
+  static void _S_large_deallocate(void *__p, uint32_t __entry) {
+    size_t __bytes = (size_t)(__entry & ~__page_map::_LARGE) * PageSource::pageSize();
+    __page_map::_S_set((size_t)__p >> __page_map::_PAGE_SHIFT, 0);
+    munmap(__p, __bytes);
+  }
+
+  __malloc_engine _M_engines[_NCLASSES];
+  alignas(__class_page_source) unsigned char _M_sources[_NCLASSES][sizeof(__class_page_source)];
+};
+
+} //* namespace sgi_stl
+
+using sgi_stl::__malloc_state;
+
+__attribute__((constructor)) static void __sgi_stl_malloc_init() {
+  __malloc_state::_S_register_atfork();
+}
+
+extern "C" {
+
+__attribute__((visibility("default"))) void *malloc(size_t __n) {
+  return __malloc_state::_S_instance()._M_malloc(__n);
+}
+
+__attribute__((visibility("default"))) void free(void *__p) {
+  __malloc_state::_S_instance()._M_free(__p);
+}
+
+__attribute__((visibility("default"))) void *calloc(size_t __nmemb, size_t __size) {
+  size_t __n;
+  if (__builtin_mul_overflow(__nmemb, __size, &__n)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  void *__p = __malloc_state::_S_instance()._M_malloc(__n);
+  //* 大块内存来自新的 mmap，已经全为 0
+  if (__p != nullptr && __n <= (size_t) __malloc_state::_MAX_BYTES) memset(__p, 0, __n);
+  return __p;
+}
+
+__attribute__((visibility("default"))) void *realloc(void *__p, size_t __n) {
+  return __malloc_state::_S_instance()._M_realloc(__p, __n);
+}
+
+__attribute__((visibility("default"))) int posix_memalign(void **__out, size_t __align, size_t __n) {
+  if (__align < sizeof(void *) || (__align & (__align - 1)) != 0) return EINVAL;
+  void *__p = __malloc_state::_S_instance()._M_memalign(__align, __n);
+  if (__p == nullptr) return ENOMEM;
+  *__out = __p;
+  return 0;
+}
+
+__attribute__((visibility("default"))) void *aligned_alloc(size_t __align, size_t __n) {
+  if (__align == 0 || (__align & (__align - 1)) != 0) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return __malloc_state::_S_instance()._M_memalign(__align, __n);
+}
+
+__attribute__((visibility("default"))) void *memalign(size_t __align, size_t __n) {
+  return aligned_alloc(__align, __n);
+}
+
+__attribute__((visibility("default"))) void *valloc(size_t __n) {
+  return __malloc_state::_S_instance()._M_memalign(PageSource::pageSize(), __n);
+}
+
+__attribute__((visibility("default"))) void *pvalloc(size_t __n) {
+  size_t __page = PageSource::pageSize();
+  //* 上调到整页时会回绕到 0
+  if (__n > SIZE_MAX - (__page - 1)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return __malloc_state::_S_instance()._M_memalign(__page, (__n + __page - 1) & ~(__page - 1));
+}
+
+//* glibc 的 reallocarray 直接调用其内部的 realloc，不替换的话会把本库开辟的内存交给 glibc 堆
+__attribute__((visibility("default"))) void *reallocarray(void *__p, size_t __nmemb, size_t __size) {
+  size_t __n;
+  if (__builtin_mul_overflow(__nmemb, __size, &__n)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return __malloc_state::_S_instance()._M_realloc(__p, __n);
+}
+
+__attribute__((visibility("default"))) size_t malloc_usable_size(void *__p) {
+  return __malloc_state::_S_usable_size(__p);
+}
+
+}
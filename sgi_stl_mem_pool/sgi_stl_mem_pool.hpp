@@ -1,14 +1,62 @@
 #ifndef SGI_STL_MEM_POOL
 #define SGI_STL_MEM_POOL
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory_resource>
 #include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "page_source.hpp"
 #define __THROW_BAD_ALLOC fprintf(stderr, "out of memory\n"); exit(1)
 
-namespace sgi_stl {
+#ifndef SGI_STL_PER_CPU
+#define SGI_STL_PER_CPU 0       //* 置 1 则小块内存经过每个 CPU 一份的缓存，内存占用随核数而不是线程数增长
+#endif
+
+#ifndef SGI_STL_THREAD_CACHE
+#define SGI_STL_THREAD_CACHE !SGI_STL_PER_CPU  //* 小块内存是否经过线程本地缓存，置 0 则每次都加锁访问全局自由链表
+#endif
+
+#if SGI_STL_PER_CPU && SGI_STL_THREAD_CACHE
+#error "SGI_STL_PER_CPU and SGI_STL_THREAD_CACHE are mutually exclusive"
+#endif
+
+#if SGI_STL_PER_CPU && defined(__linux__) && __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#endif
+
+#ifndef SGI_STL_LOCK_FREE
+#define SGI_STL_LOCK_FREE 0     //* 置 1 则全局自由链表改为无锁栈，mtx 只在切分新 chunk 的慢速路径上加锁
+#endif
+
+#ifndef SGI_STL_REMOTE_FREE
+#define SGI_STL_REMOTE_FREE 0   //* 置 1 则小块内存从分配线程自己的堆中切分，其他线程释放时压入该堆的无锁队列
+#endif
+
+#if SGI_STL_REMOTE_FREE && !SGI_STL_THREAD_CACHE
+#error "SGI_STL_REMOTE_FREE requires SGI_STL_THREAD_CACHE"
+#endif
 
-extern void *memcpy (void *__restrict __dest, const void *__restrict __src,
-		     size_t __n) __THROW __nonnull ((1, 2));
+#ifndef SGI_STL_STATS
+#define SGI_STL_STATS 0         //* 置 1 则统计各尺寸类别的命中、未命中、补充次数，关闭时计数代码完全不参与编译
+#endif
+
+#if SGI_STL_STATS
+#define __SGI_STL_STAT(__stmt) __stmt
+#else
+#define __SGI_STL_STAT(__stmt)
+#endif
+
+namespace sgi_stl {
 
 //* 封装 malloc 和 free，可设置 oom 释放内存的回调函数
 template <int __inst>
@@ -84,110 +132,189 @@ void *__malloc_alloc_template<__inst>::_S_oom_realloc(void *__p, size_t __n)
 
 typedef __malloc_alloc_template<0> malloc_alloc;
 
-template<typename T>
-class Allocator {
-public:
-  using value_type = T;
-
-  constexpr Allocator() noexcept {}
-  constexpr Allocator(const Allocator &) noexcept = default;
-  template <class _Other>
-  constexpr Allocator(const Allocator<_Other> &) noexcept {}
-
-  //* 内存开辟
-  T *allocate(long unsigned int __n) {
-    __n = __n * sizeof(T);
+//* 编译期定长数组，constexpr 函数通过它返回查找表
+template <typename _Tp, int _Num>
+struct __ctable {
+  _Tp _M_v[_Num];
+};
 
-    void *__ret = nullptr;
+//* 尺寸类别的生成规则：从 8 开始，不超过 _LinearBytes 时按 8 字节线性递增，
+//* 之后每翻一倍分为 _StepsPerDoubling 级几何递增，直到 _MaxBytes
+//* 不超过 1024 的类别是 8 的倍数，超过 1024 的类别是 128 的倍数，查找表据此按两种粒度建立
+template <long unsigned int _MaxBytes, long unsigned int _LinearBytes, int _StepsPerDoubling>
+struct __size_class_rule {
+  static_assert(_MaxBytes >= 8 && _MaxBytes % 8 == 0, "_MaxBytes must be a multiple of 8");
+  static_assert(_MaxBytes <= 1024 || _MaxBytes % 128 == 0, "_MaxBytes above 1024 must be a multiple of 128");
+  static_assert(_StepsPerDoubling > 0, "_StepsPerDoubling must be positive");
 
-    //* 如果申请的不是小块内存(> 128 bytes)，仍采用默认的空间配置器(malloc、free管理)
-    if (__n > (long unsigned int) _MAX_BYTES) {
-      __ret = malloc_alloc::allocate(__n);
+  //* 紧跟在 __size 之后的下一个类别尺寸
+  static constexpr long unsigned int _S_next(long unsigned int __size) {
+    long unsigned int __next = 0;
+    if (__size < _LinearBytes) {
+      __next = __size + 8;
     } else {
-      //* 二级指针_Obj **，申请的自由链表 = 存储自由链表的数组名(起始地址) + 申请字节数映射的链表位置
-      _Obj *volatile * __my_free_list = _S_free_list + _S_freelist_index(__n);
-
-      //* 操作链表时加锁，lock_guard 出作用域后锁自动析构
-      std::lock_guard<std::mutex> guard(mtx);
-
-      //* 对二级指针解引用，拿到指向的 _Obj * (头结点)
-      _Obj *__result = *__my_free_list;
-
-      if (__result == nullptr) {
-        //*  如果 n 对应的链表为空，或者已经是最后一个节点的下个节点指针(即 0)，分配内存块，让 ret 指向新分配的首节点
-        __ret = _S_refill(_S_round_up(__n));
-      } else {
-        //* 如果不为空，将头节点的下一个节点的地址，赋给 __my_free_list
-        *__my_free_list = __result -> _M_free_list_link;
-        //* 将刚才的节点分配出去，此时链表不为空，且 __my_free_list 指向的是下次可往外分配的节点
-        //* 下一次申请该链表中的内存块时，再找到下一个节点的指针赋给 __my_free_list ，并将当前节点分配出去
-        __ret = __result;
-      }
+      long unsigned int __pow = 8;
+      while (__pow * 2 <= __size) __pow *= 2;
+      __next = __size + __pow / _StepsPerDoubling;
     }
+    __next = __next > 1024 ? ((__next + 127) & ~127UL) : ((__next + 7) & ~7UL);
+    return __next > _MaxBytes ? _MaxBytes : __next;
+  }
 
-    return (T *)__ret;
+  static constexpr int _S_count() {
+    int __n = 1;
+    for (long unsigned int __size = 8; __size < _MaxBytes; __size = _S_next(__size)) ++__n;
+    return __n;
   }
+};
 
-  //* 内存释放
-  void deallocate(void *__p, long unsigned int __n) {
-    //* 如果归还的内存大小大于128字节，说明不是内存池申请的，而是 malloc，所以应 free
-    if (__n > (long unsigned int) _MAX_BYTES) {
-      malloc_alloc::deallocate(__p, __n);
-    } else {
-      //* 将通过内存池申请的内存块 归还到内存池相应的位置中
-      //* 首先定位该内存块对应的静态链表的二级指针
-      _Obj *volatile *__my_free_list = _S_free_list + _S_freelist_index(__n);
-      //* 找到链表后，定位该内存块在链表中对应的节点位置
-      _Obj *__q = (_Obj *)__p;
+//* 自由链表的尺寸类别策略，作为 Allocator 的第二个模板参数
+//* 所有查找表都在编译期生成，运行时由字节数映射到链表索引只需一次查表，不做除法
+//* 自定义策略只需提供同样的 _S_max_bytes、_S_nclasses、_S_index、_S_floor_index、_S_size、_S_batch
+template <long unsigned int _MaxBytes = 128, long unsigned int _LinearBytes = _MaxBytes, int _StepsPerDoubling = 4>
+class __size_class {
+  typedef __size_class_rule<_MaxBytes, _LinearBytes, _StepsPerDoubling> _Rule;
 
-      std::lock_guard<std::mutex> guard(mtx);
+public:
+  static constexpr long unsigned int _S_max_bytes = _MaxBytes;  //* 由自由链表管理的最大内存块
+  static constexpr int _S_nclasses = _Rule::_S_count();          //* 自由链表的个数
+  static_assert(_S_nclasses <= 255, "too many size classes");
 
-      //* 让要归还节点的 _M_free_list_link 指针指向当前链表中第一个空闲节点
-      __q -> _M_free_list_link = *__my_free_list;
-      //* 然后将当前链表的头指针指向要归还的节点，从之前指向的第一个空闲节点变成了要归还的节点
-      //* 并且要归还的节点的 _M_free_list_link (next指针) 指向之前的第一个空闲节点
-      *__my_free_list = __q;
-      // lock is released here
-    }
+private:
+  enum { _SMALL_SLOTS = ((_MaxBytes < 1024 ? _MaxBytes : 1024) >> 3) + 1 };  //* 以 8 字节为粒度的表项数
+  enum { _LARGE_SLOTS = _MaxBytes > 1024 ? (_MaxBytes >> 7) + 1 : 1 };        //* 以 128 字节为粒度的表项数
+  enum { _BATCH_BYTES = 4096 };  //* 一次批量搬运的目标字节数，小类别搬运个数另以 20 为上限
+
+  //* 每个类别的尺寸
+  static constexpr __ctable<long unsigned int, _S_nclasses> _S_sizes = [] {
+    __ctable<long unsigned int, _S_nclasses> __t{};
+    long unsigned int __size = 8;
+    for (int __i = 0; __i < _S_nclasses; ++__i, __size = _Rule::_S_next(__size)) __t._M_v[__i] = __size;
+    return __t;
+  }();
+
+  //* 第一个尺寸不小于 __bytes 的类别
+  static constexpr unsigned char _S_ceil(long unsigned int __bytes) {
+    int __i = 0;
+    while (_S_sizes._M_v[__i] < __bytes) ++__i;
+    return (unsigned char)__i;
   }
 
-  //* 内存扩容/缩容
-  void *reallocate(void *__p, long unsigned int __old_sz, long unsigned int __new_sz) {
-    void *__result;
-    long unsigned int __copy_sz;
+  //* 字节数 (0, 1024] 按 (__bytes + 7) >> 3 查找
+  static constexpr __ctable<unsigned char, _SMALL_SLOTS> _S_small_index = [] {
+    __ctable<unsigned char, _SMALL_SLOTS> __t{};
+    for (int __i = 0; __i < _SMALL_SLOTS; ++__i) __t._M_v[__i] = _S_ceil((long unsigned int)__i << 3);
+    return __t;
+  }();
 
-    //* 如果内存不是从内存池开辟的，直接调用 realloc
-    if (__old_sz > (long unsigned int) _MAX_BYTES && __new_sz > (long unsigned int) _MAX_BYTES) {
-      return(realloc(__p, __new_sz));
+  //* 字节数 (1024, _MaxBytes] 按 (__bytes + 127) >> 7 查找
+  static constexpr __ctable<unsigned char, _LARGE_SLOTS> _S_large_index = [] {
+    __ctable<unsigned char, _LARGE_SLOTS> __t{};
+    for (int __i = 0; __i < _LARGE_SLOTS; ++__i) {
+      __t._M_v[__i] = (long unsigned int)__i << 7 > 1024 ? _S_ceil((long unsigned int)__i << 7) : 0;
     }
-    //* 如果新旧尺寸映射 8 的倍数后 chunk 大小相同，不用扩容或者缩容，直接返回
-    if (_S_round_up(__old_sz) == _S_round_up(__new_sz)) {
-      return(__p);
+    return __t;
+  }();
+
+  //* 每个类别在线程缓存与全局链表之间、以及 _S_refill 一次切分的节点数
+  static constexpr __ctable<int, _S_nclasses> _S_batches = [] {
+    __ctable<int, _S_nclasses> __t{};
+    for (int __i = 0; __i < _S_nclasses; ++__i) {
+      long unsigned int __n = _BATCH_BYTES / _S_sizes._M_v[__i];
+      __t._M_v[__i] = __n > 20 ? 20 : (__n < 2 ? 2 : (int)__n);
     }
-    //* 以新尺寸开辟内存
-    __result = allocate(__new_sz);
-    //* 扩容就 copy __old_sz，缩容就 copy __new_sz
-    __copy_sz = __new_sz > __old_sz ? __old_sz : __new_sz;
-    memcpy(__result, __p, __copy_sz);
-    //* 归还 __old_sz chunk块
-    deallocate(__p, __old_sz);
-    return(__result);
+    return __t;
+  }();
+
+public:
+  //* 返回申请 __bytes 大小的内存块在自由链表中的索引，__bytes 不超过 _S_max_bytes
+  static long unsigned int _S_index(long unsigned int __bytes) {
+    return __bytes <= 1024 ? _S_small_index._M_v[(__bytes + 7) >> 3]
+                           : _S_large_index._M_v[(__bytes + 127) >> 7];
   }
 
-  //* 对象构造
-  void construct(T *__p, const T &val) {
-    new (__p) T(val);
+  //* 返回尺寸不超过 __bytes 的最大类别，没有则返回 -1，用于安置切分剩余的零头
+  static int _S_floor_index(long unsigned int __bytes) {
+    if (__bytes >= _MaxBytes) return _S_nclasses - 1;
+    int __i = (int)_S_index(__bytes);
+    return _S_sizes._M_v[__i] == __bytes ? __i : __i - 1;
   }
-  //* 对象析构
-  void destory(T *__p) {
-    __p->~T();
+
+  //* 第 __index 个链表中内存块的字节数
+  static long unsigned int _S_size(long unsigned int __index) {
+    return _S_sizes._M_v[__index];
   }
 
+  //* 第 __index 个链表一次批量搬运的节点数
+  static int _S_batch(long unsigned int __index) {
+    return _S_batches._M_v[__index];
+  }
+};
 
-private:
-  enum {    _ALIGN = 8    };  //* 自由链表以 8 字节为对齐方式从 8 扩充到 128
-  enum { _MAX_BYTES = 128 };  //* 内存池最大的 chunk 块
-  enum { _NFREELISTS = 16 };  //* 自由链表的个数
+//* Allocator::stats() 和 pool_resource::stats() 返回的快照
+struct pool_stats {
+  struct size_class_stats {
+    long unsigned int size;            //* 类别尺寸
+    long unsigned int hits;            //* 快速路径(线程缓存或全局链表)直接取到节点的次数
+    long unsigned int misses;          //* 快速路径为空、需要进入慢速路径的次数
+    long unsigned int refills;         //* 切分新内存补充该链表的次数
+    long unsigned int free_objects;    //* 全局自由链表上的节点数
+    long unsigned int cached_objects;  //* 各线程缓存或每 CPU 缓存中的节点数(需开启 SGI_STL_STATS)
+    long unsigned int refill_objects;  //* 下次 _S_refill 切分的节点数
+  };
+
+  std::vector<size_class_stats> classes;
+  long unsigned int heap_size;         //* 向内存来源申请的总字节数 _S_heap_size
+  long unsigned int chunk_count;       //* 持有的 chunk 个数
+  long unsigned int free_list_bytes;   //* 全局自由链表上的字节数
+  long unsigned int cached_bytes;      //* 各线程缓存中的字节数
+  long unsigned int pool_left_bytes;   //* _S_start_free 与 _S_end_free 之间尚未切分的字节数
+
+  //* 按 "名称{标签} 数值" 逐行输出，可直接交给 Prometheus 一类的指标采集
+  std::string to_string(const char *__prefix = "sgi_stl_pool") const {
+    std::string __out;
+    char __line[160];
+    auto __emit = [&](const char *__name, const char *__label, long unsigned int __value) {
+      snprintf(__line, sizeof(__line), "%s_%s%s %lu\n", __prefix, __name, __label, __value);
+      __out += __line;
+    };
+    __emit("heap_size_bytes", "", heap_size);
+    __emit("chunks", "", chunk_count);
+    __emit("free_list_bytes", "", free_list_bytes);
+    __emit("cached_bytes", "", cached_bytes);
+    __emit("pool_left_bytes", "", pool_left_bytes);
+    for (const size_class_stats &__c : classes) {
+      char __label[32];
+      snprintf(__label, sizeof(__label), "{size=\"%lu\"}", __c.size);
+      __emit("hits", __label, __c.hits);
+      __emit("misses", __label, __c.misses);
+      __emit("refills", __label, __c.refills);
+      __emit("free_objects", __label, __c.free_objects);
+      __emit("cached_objects", __label, __c.cached_objects);
+      __emit("refill_objects", __label, __c.refill_objects);
+    }
+    return __out;
+  }
+};
+
+//* 原 SGI STL 的划分：8 字节对齐从 8 扩充到 128，共 16 个自由链表
+typedef __size_class<128> default_size_class;
+//* tcmalloc 风格的划分：64 字节以内按 8 字节递增，之后每翻一倍分四级，一直到 4KB
+typedef __size_class<4096, 64, 4> tcmalloc_size_class;
+
+//* 自由链表内存池的后端：自由链表、备用内存池、chunk 登记和慢启动状态都是实例成员
+//* 同一尺寸类别策略下的所有 Allocator<T> 共用一个全局实例(__global_pool::_S_engine)，
+//* vector<string> 和容器内部 rebind 出的分配器都从同一组链表取节点，不再各自切分 chunk；
+//* pool_resource 则各自持有一个实例，可以按子系统划分内存池
+//* 线程缓存和每 CPU 缓存只属于全局实例，独立实例每次都直接访问自己的自由链表
+//* _M_align 大于 8 的实例只使用尺寸是 _M_align 倍数的类别，并从对齐的地址开始切分，
+//* 链表上的每个节点都满足该对齐要求，供 alignas(64) 一类的对象使用
+template <typename _SizeClass>
+class __pool_engine {
+public:
+  enum {    _ALIGN = 8    };                              //* 所有尺寸类别都是 8 的倍数
+  enum { _MAX_BYTES = _SizeClass::_S_max_bytes };         //* 内存池最大的 chunk 块
+  enum { _NFREELISTS = _SizeClass::_S_nclasses };         //* 自由链表的个数
 
   //* 每个 chunk 块的头信息
   union _Obj {
@@ -195,6 +322,21 @@ private:
     char _M_client_data[1];
   };
 
+  //* 每个 chunk 开头的登记信息，所有 chunk 串成链表，trim 时据此判断哪些 chunk 已经完全空闲
+  struct alignas(16) _Chunk {
+    _Chunk *_M_next;              //* 下一个 chunk
+    long unsigned int _M_size;    //* 可切分部分的字节数，紧跟在登记信息之后
+    long unsigned int _M_wasted;  //* 切分剩余、无法放入任何链表而舍弃的字节数
+    PageSource *_M_source;        //* 开辟该 chunk 的内存来源，交还时使用
+    bool _M_dormant;              //* 无锁模式下已交还物理页、等待复用
+  };
+
+  //* 所有成员都能常量初始化，全局实例不依赖静态初始化顺序
+  constexpr __pool_engine() noexcept = default;
+  constexpr explicit __pool_engine(unsigned int __align) noexcept : _M_align(__align) {}
+  __pool_engine(const __pool_engine &) = delete;
+  __pool_engine &operator=(const __pool_engine &) = delete;
+
   //* 将 __bytes 上调为最邻近的 8 的倍数
   static long unsigned int _S_round_up(long unsigned int __bytes) {
     return (((__bytes) + (long unsigned int)_ALIGN - 1) & ~((long unsigned int)_ALIGN - 1));
@@ -202,17 +344,262 @@ private:
 
   //* 返回申请 __bytes 大小的内存块在自由链表中的索引
   static long unsigned int _S_freelist_index(long unsigned int __bytes) {
-    return (((__bytes) + (long unsigned int)_ALIGN - 1) / ((long unsigned int)_ALIGN - 1));
+    return _SizeClass::_S_index(__bytes);
+  }
+
+  //* 能容纳 __bytes 且尺寸是 _M_align 倍数的最小类别，没有则返回 -1
+  int _M_index(long unsigned int __bytes) const {
+    if (__bytes > (long unsigned int) _MAX_BYTES) return -1;
+    int __i = (int)_S_freelist_index(__bytes);
+    while (__i < (int) _NFREELISTS && _SizeClass::_S_size(__i) % _M_align != 0) ++__i;
+    return __i < (int) _NFREELISTS ? __i : -1;
+  }
+
+  //* 尺寸不超过 __bytes 且是 _M_align 倍数的最大类别，没有则返回 -1，用于安置切分剩余的零头
+  int _M_floor_index(long unsigned int __bytes) const {
+    if (_M_single_class) return -1;
+    int __i = _SizeClass::_S_floor_index(__bytes);
+    while (__i >= 0 && _SizeClass::_S_size(__i) % _M_align != 0) --__i;
+    return __i;
+  }
+
+  //* 从自由链表中取一个第 __index 类的内存块
+  void *_M_allocate(long unsigned int __index) {
+    _Obj *__result;
+
+#if SGI_STL_LOCK_FREE
+    //* 无锁模式下先直接 CAS 弹出，只有链表为空时才进入下面加锁的慢速路径
+    __result = _M_pop_one(__index);
+    if (__result != nullptr) {
+      __SGI_STL_STAT(_M_hits[__index].fetch_add(1, std::memory_order_relaxed));
+      return __result;
+    }
+#endif
+
+    //* 操作链表时加锁，lock_guard 出作用域后锁自动析构
+    std::lock_guard<std::mutex> guard(mtx);
+
+    //* 取链表头结点；无锁模式下其他线程可能已在我们等锁期间补充了链表，再试一次
+    __result = _M_pop_one(__index);
+    __SGI_STL_STAT((__result != nullptr ? _M_hits : _M_misses)[__index].fetch_add(1, std::memory_order_relaxed));
+    if (__result == nullptr) {
+      //*  如果 n 对应的链表为空，或者已经是最后一个节点的下个节点指针(即 0)，分配内存块，让 ret 指向新分配的首节点
+      return _M_refill(_SizeClass::_S_size(__index));
+    }
+    return __result;
+  }
+
+  //* 将第 __index 类的内存块归还到自由链表
+  void _M_deallocate(void *__p, long unsigned int __index) {
+    _Obj *__q = (_Obj *)__p;
+    _Free_list_lock __guard(*this);
+    _M_push_chain(__index, __q, __q);
+  }
+
+  //* 自由链表的读写锁：加锁模式下即 mtx，无锁模式下为空操作
+  struct _Free_list_lock {
+#if SGI_STL_LOCK_FREE
+    explicit _Free_list_lock(__pool_engine &) {}
+#else
+    explicit _Free_list_lock(__pool_engine &__engine) : _M_mtx(__engine.mtx) { _M_mtx.lock(); }
+    ~_Free_list_lock() { _M_mtx.unlock(); }
+    std::mutex &_M_mtx;
+#endif
+    _Free_list_lock(const _Free_list_lock &) = delete;
+    _Free_list_lock &operator=(const _Free_list_lock &) = delete;
+  };
+
+  //* 以下三个函数是对自由链表的全部操作
+  //* 加锁模式下调用者须持有 mtx；无锁模式下每个链表是一个带版本号的 Treiber 栈，可任意并发调用
+
+#if SGI_STL_LOCK_FREE
+  //* 链表头为一个 64 位字：低 48 位存节点地址(用户态地址不超过 48 位)，高 16 位存版本号
+  //* 每次修改链表头都使版本号加一，节点被弹出又压回时 CAS 会因版本号不同而失败，避免 ABA 问题
+  //* 5 级页表(LA57)下的高位地址或带标签的指针(ARM TBI/MTE)放不进低 48 位，_M_new_chunk 开辟 chunk 时检查
+  enum { _TAG_SHIFT = 48 };
+  static_assert(sizeof(void *) == 8 && sizeof(unsigned long) == 8, "SGI_STL_LOCK_FREE requires 64-bit pointers");
+
+  static bool _S_taggable(const void *__p, long unsigned int __n) {
+    return ((long unsigned int)__p + __n - 1) >> _TAG_SHIFT == 0;
+  }
+
+  static _Obj *_S_untag(unsigned long __head) {
+    return (_Obj *)(__head & ((1UL << _TAG_SHIFT) - 1));
+  }
+
+  static unsigned long _S_retag(_Obj *__p, unsigned long __old_head) {
+    return (unsigned long)__p | (((__old_head >> _TAG_SHIFT) + 1) << _TAG_SHIFT);
   }
+#endif
 
-  //* 连接分配好的 chunk 块
-  static void *_S_refill(long unsigned int __n) {
-    //* 在当前链表中开辟的 chunk 块的个数
-    int __nobjs = 20;
-    //* 内存块开辟，返回起始地址
-    char *__chunk = _S_chunk_alloc(__n, __nobjs);
-    //* _Obj 的二级指针，用于遍历指针数组
-    _Obj *volatile * __my_free_list;
+  //* 将 [__head, __tail] 这一段已串好的节点整段压入第 __index 个链表
+  void _M_push_chain(long unsigned int __index, _Obj *__head, _Obj *__tail) {
+#if SGI_STL_LOCK_FREE
+    std::atomic<unsigned long> &__list = _M_free_list[__index];
+    unsigned long __old = __list.load(std::memory_order_relaxed);
+    do {
+      __tail -> _M_free_list_link = _S_untag(__old);
+    } while (!__list.compare_exchange_weak(__old, _S_retag(__head, __old),
+                                           std::memory_order_release, std::memory_order_relaxed));
+#else
+    //* 让段尾节点的 _M_free_list_link 指针指向当前链表中第一个空闲节点，再将链表头指向段首节点
+    __tail -> _M_free_list_link = _M_free_list[__index];
+    _M_free_list[__index] = __head;
+#endif
+  }
+
+  //* 弹出第 __index 个链表的头结点，链表为空时返回 nullptr
+  _Obj *_M_pop_one(long unsigned int __index) {
+#if SGI_STL_LOCK_FREE
+    std::atomic<unsigned long> &__list = _M_free_list[__index];
+    unsigned long __old = __list.load(std::memory_order_acquire);
+    _Obj *__result;
+    do {
+      __result = _S_untag(__old);
+      if (__result == nullptr) return nullptr;
+      //* __result 可能刚被其他线程弹出并写入了用户数据，读到的 next 是脏值也无妨：
+      //* 那种情况下链表头的版本号已经变化，下面的 CAS 必然失败。内存块从不解除映射，读操作本身总是安全的
+    } while (!__list.compare_exchange_weak(
+                 __old, _S_retag(__atomic_load_n(&__result -> _M_free_list_link, __ATOMIC_RELAXED), __old),
+                 std::memory_order_acquire, std::memory_order_acquire));
+    return __result;
+#else
+    _Obj *__result = _M_free_list[__index];
+    if (__result != nullptr) {
+      //* 将头节点的下一个节点的地址赋给链表头，下一次申请时再分配下一个节点
+      _M_free_list[__index] = __result -> _M_free_list_link;
+    }
+    return __result;
+#endif
+  }
+
+  //* 从第 __index 个链表头部至多取 __max 个节点，返回以 nullptr 结尾的一段，实际个数存入 __count
+  _Obj *_M_pop_chain(long unsigned int __index, int __max, int &__count) {
+    _Obj *__head = nullptr;
+    _Obj *__tail = nullptr;
+    __count = 0;
+#if SGI_STL_LOCK_FREE
+    //* 无锁栈上无法安全地一次遍历多个节点(可能沿脏指针走到非法地址)，逐个 CAS 弹出
+    while (__count < __max) {
+      _Obj *__p = _M_pop_one(__index);
+      if (__p == nullptr) break;
+      if (__tail == nullptr) __head = __p; else __tail -> _M_free_list_link = __p;
+      __tail = __p;
+      ++__count;
+    }
+    if (__tail != nullptr) __tail -> _M_free_list_link = nullptr;
+#else
+    __head = _M_free_list[__index];
+    if (__head == nullptr) return nullptr;
+    __tail = __head;
+    __count = 1;
+    while (__count < __max && __tail -> _M_free_list_link != nullptr) {
+      __tail = __tail -> _M_free_list_link;
+      ++__count;
+    }
+    _M_free_list[__index] = __tail -> _M_free_list_link;
+    __tail -> _M_free_list_link = nullptr;
+#endif
+    return __head;
+  }
+
+  //* 从链表取一批节点供上层缓存使用：返回以 nullptr 结尾的一段，至少一个、至多 __batch 个，个数存入 __count
+  //* 链表为空时由 _M_refill 切分新的 chunk 块，剩余节点挂在链表上
+  _Obj *_M_pop_batch(long unsigned int __index, int __batch, int &__count) {
+    _Obj *__chain = nullptr;
+#if SGI_STL_LOCK_FREE
+    __chain = _M_pop_chain(__index, __batch, __count);
+    if (__chain != nullptr) return __chain;
+#endif
+    std::lock_guard<std::mutex> guard(mtx);
+    __chain = _M_pop_chain(__index, __batch, __count);
+    if (__chain == nullptr) {
+      __chain = (_Obj *)_M_refill(_SizeClass::_S_size(__index));
+      __chain -> _M_free_list_link = _M_pop_chain(__index, __batch - 1, __count);
+      ++__count;
+    }
+    return __chain;
+  }
+
+  enum { _BULK_OBJS = 4096 };  //* 批量接口单次切分 chunk 的最多节点数
+
+  //* 取出恰好 __n 个第 __index 类的节点，返回以 nullptr 结尾的一段
+  //* 先整段摘取自由链表，不足部分在同一次加锁内由 _M_chunk_alloc 切分新的 chunk 补足
+  _Obj *_M_fetch_chain(long unsigned int __index, long unsigned int __n) {
+    long unsigned int __size = _SizeClass::_S_size(__index);
+    _Obj *__head = nullptr;
+    _Obj *__tail = nullptr;
+    long unsigned int __got = 0;
+    int __count;
+
+    //* 把 [__first, __last] 接到已取得的一段末尾
+    auto __append = [&](_Obj *__first, _Obj *__last, long unsigned int __num) {
+      if (__tail == nullptr) __head = __first; else __tail -> _M_free_list_link = __first;
+      __tail = __last;
+      __got += __num;
+    };
+
+    //* 无锁模式下不加锁弹出已有节点，只为切分新 chunk 加锁
+    std::unique_lock<std::mutex> __lock(mtx, std::defer_lock);
+#if !SGI_STL_LOCK_FREE
+    __lock.lock();
+#endif
+    while (__got < __n) {
+      int __want = __n - __got > (long unsigned int) _BULK_OBJS ? (int) _BULK_OBJS : (int)(__n - __got);
+      _Obj *__chain = _M_pop_chain(__index, __want, __count);
+      if (__chain == nullptr) break;
+      _Obj *__last = __chain;
+      while (__last -> _M_free_list_link != nullptr) __last = __last -> _M_free_list_link;
+      __append(__chain, __last, __count);
+    }
+    if (__got < __n && !__lock.owns_lock()) __lock.lock();
+    while (__got < __n) {
+      //* 直接切分连续的 chunk，节点在内存中相邻，遍历新建的容器时局部性也更好
+      int __nobjs = __n - __got > (long unsigned int) _BULK_OBJS ? (int) _BULK_OBJS : (int)(__n - __got);
+      char *__chunk = _M_chunk_alloc(__size, __nobjs);
+      __SGI_STL_STAT(_M_refills[__index].fetch_add(1, std::memory_order_relaxed));
+      for (int __i = 0; __i < __nobjs - 1; ++__i) {
+        ((_Obj *)(__chunk + __i * __size)) -> _M_free_list_link = (_Obj *)(__chunk + (__i + 1) * __size);
+      }
+      __append((_Obj *)__chunk, (_Obj *)(__chunk + (__nobjs - 1) * __size), __nobjs);
+    }
+    __tail -> _M_free_list_link = nullptr;
+    return __head;
+  }
+
+  //* 每个类别 _M_refill 一次切分的节点数按慢启动调整：从 _REFILL_START 开始，
+  //* 每补充一次翻倍，直到该类别批量搬运个数的 _REFILL_GROWTH 倍；有整批节点交还时减半
+  //* 热点类别很快增长到上限，进入慢速路径的次数随之减少；冷门类别只切分少量节点，不占住用不到的内存
+  enum { _REFILL_START = 2, _REFILL_GROWTH = 8 };
+
+  int _M_refill_count(long unsigned int __index) const {
+    int __nobjs = _M_refill_objs[__index].load(std::memory_order_relaxed);
+    return __nobjs < (int) _REFILL_START ? (int) _REFILL_START : __nobjs;
+  }
+
+  //* 只在持有 mtx 的 _M_refill 中调用，读写之间不会有其他线程增长
+  void _M_refill_grow(long unsigned int __index, int __nobjs) {
+    int __cap = _REFILL_GROWTH * _SizeClass::_S_batch(__index);
+    _M_refill_objs[__index].store(__nobjs * 2 > __cap ? __cap : __nobjs * 2, std::memory_order_relaxed);
+  }
+
+  //* 可能与 _M_refill 并发，丢失一次减半无关紧要
+  void _M_refill_shrink(long unsigned int __index) {
+    int __nobjs = _M_refill_objs[__index].load(std::memory_order_relaxed);
+    if (__nobjs > (int) _REFILL_START) {
+      _M_refill_objs[__index].store(__nobjs / 2, std::memory_order_relaxed);
+    }
+  }
+
+  //* 连接分配好的 chunk 块，调用者持有 mtx
+  void *_M_refill(long unsigned int __n) {
+    //* 在当前链表中开辟的 chunk 块的个数，由慢启动决定
+    int __nobjs = _M_refill_count(_S_freelist_index(__n));
+    _M_refill_grow(_S_freelist_index(__n), __nobjs);
+    //* 内存块开辟，返回起始地址；只有 _M_can_fail 的实例会失败
+    char *__chunk = _M_chunk_alloc(__n, __nobjs);
+    if (__chunk == nullptr) return nullptr;
+    __SGI_STL_STAT(_M_refills[_S_freelist_index(__n)].fetch_add(1, std::memory_order_relaxed));
     //* 定义局部变量，用于存储遍历过程中的节点
     _Obj *__result;
     _Obj *__current_obj;
@@ -222,14 +609,11 @@ private:
     //* 备用内存池只够申请 1 个新字节大小的内存块，就直接返回 chunk 块的起始地址
     if (1 == __nobjs) return(__chunk);
 
-    //* 定位到申请 chunk 块字节数所映射的链表
-    __my_free_list = _S_free_list + _S_freelist_index(__n);
-
     /* Build free list in chunk */
       __result = (_Obj *)__chunk;  //* 让 __result 也指向 __chunk指向的新申请的内存池的起始地址
-      //* 让二级指针指向的 _Obj * 和 __next_obj 都指向新申请的内存池的起始地址的下一个节点，因为新申请内存
-      //* 池的首节点要分配出去，此时指针数组的第 __my_free_list 个链表指针 元素的首节点还是未分配出去的空闲内存块
-      *__my_free_list = __next_obj = (_Obj *)(__chunk + __n);
+      //* 让 __next_obj 指向新申请的内存池的起始地址的下一个节点，因为新申请内存池的首节点要分配出去，
+      //* 从第二个节点开始的所有节点串好之后整段挂到申请字节数所映射的链表上
+      __next_obj = (_Obj *)(__chunk + __n);
       //! for 循环让每个内存块的 M_free_list_link 指针(相当于next指针)指向下一个节点的地址，将节点连起来
       for (__i = 1; ; __i++) {
         //* 将 __next_obj 赋值给 __current_obj
@@ -244,130 +628,1342 @@ private:
             __current_obj -> _M_free_list_link = __next_obj;
         }
       }
+    //* 将串好的 [第二个节点, 最后一个节点] 整段压入对应链表
+    _M_push_chain(_S_freelist_index(__n), (_Obj *)(__chunk + __n), __current_obj);
     //* 返回要分配出去的节点
     return(__result);
   }
 
-  //* 分配自由链表的 chunk 块
-  static char *_S_chunk_alloc(long unsigned int __size, int &__nobjs) {
+  //* 调用者持有 mtx；_M_can_fail 的实例在内存来源开辟失败时返回 nullptr
+  char *_M_chunk_alloc(long unsigned int __size, int &__nobjs) {
     char *__result;
     long unsigned int __total_bytes = __size * __nobjs;  //* 计算内存池需要分配的字节数
-    //* 计算剩余空闲字节数| 40块都用完时，_S_end_free 和 _S_start_free 都在末尾，结果为 0
-    long unsigned int __bytes_left = _S_end_free - _S_start_free;
+    //* 计算剩余空闲字节数| 40块都用完时，_M_end_free 和 _M_start_free 都在末尾，结果为 0
+    long unsigned int __bytes_left = _M_end_free - _M_start_free;
     //* 最初 __bytes_left = 0 - 0 = 0
     //* 第一次分配的所有 chunk 块用完时，再进来时： __bytes_left == __total_bytes
     if (__bytes_left >= __total_bytes) {
       //* 让 __result 指向即将被分配出去的 chunk 块
-      __result = _S_start_free;
-      //* 让 _S_start_free 指向第 21 个 chunk 块(第一次)
-      //* 让 _S_start_free 指向第 40 个 chunk 块(第二次)
-      _S_start_free += __total_bytes;
-      //* 返回即将被分配出去的所有 chunk 块的头指针 __result，在 _S_refill 函数中将所有 chunk 块连起来
+      __result = _M_start_free;
+      //* 让 _M_start_free 指向第 21 个 chunk 块(第一次)
+      //* 让 _M_start_free 指向第 40 个 chunk 块(第二次)
+      _M_start_free += __total_bytes;
+      //* 返回即将被分配出去的所有 chunk 块的头指针 __result，在 _M_refill 函数中将所有 chunk 块连起来
       return(__result);
     } else if (__bytes_left >= __size) {
       //* 申请其他大小的内存块时，先从备用的内存池中想办法，直接作为新字节大小的 chunk 块使用
       //* 计算一下备用内存池相当于几块新大小的 chunk 块
       __nobjs = (int)(__bytes_left/__size);
       __total_bytes = __size * __nobjs;
-      __result = _S_start_free; //* __result 指向备用内存池的第一个 chunk 块(即原来第 21 个 chunk)
-      //* ① _S_start_free 移动到 _S_end_free 处(正常情况下)
-      //* ② _S_start_free 移动到以新大小划分的末尾处(备用内存池无法整除新 chunk 大小的情况下)
-      _S_start_free += __total_bytes;
-      //* 返回第一个 chunk 块的地址，然后在 _S_refill 函数中串起来所有 chunk
+      __result = _M_start_free; //* __result 指向备用内存池的第一个 chunk 块(即原来第 21 个 chunk)
+      //* ① _M_start_free 移动到 _M_end_free 处(正常情况下)
+      //* ② _M_start_free 移动到以新大小划分的末尾处(备用内存池无法整除新 chunk 大小的情况下)
+      _M_start_free += __total_bytes;
+      //* 返回第一个 chunk 块的地址，然后在 _M_refill 函数中串起来所有 chunk
       //* 接着在 allocate 函数中将第一个 chunk 块分配出去，并将链表头指针指向下一个空闲 chunk
       return(__result);
     } else {
-      //* __bytes_to_get 为两倍 __total_bytes 加上 (_S_heap_size 右移 4 位后向 8 取整)
-      //* _S_heap_size 会越来越大，所以随着内存的不断申请，新申请的内存块空间也越来越大
+      //* __bytes_to_get 为两倍 __total_bytes 加上 (_M_heap_size 右移 4 位后向 8 取整)
+      //* _M_heap_size 会越来越大，所以随着内存的不断申请，新申请的内存块空间也越来越大
       //* 第一次：0 右移 4 位再取整，结果为 0
-      long unsigned int __bytes_to_get = 2 * __total_bytes + _S_round_up(_S_heap_size >> 4);
+      long unsigned int __bytes_to_get = 2 * __total_bytes + _S_round_up(_M_heap_size >> 4);
+      //* chunk 的可切分部分只保证 16 字节对齐，对齐实例多申请一些，用于把起始地址上调到 _M_align
+      if (_M_align > 16) __bytes_to_get += _M_align;
       // Try to make use of the left-over piece.
       //* 备用内存池以新大小划分 chunk 块后，还剩余一部分未利用的空间，且该部分空间不足以划分一块当前大小的 chunk
+      //* 类别不是等距划分时剩余空间不一定恰好是某个类别的尺寸，放入不超过它的最大类别，尾部零头舍弃
+      //* 对齐实例中 _M_start_free 总是对齐的，只放入尺寸是 _M_align 倍数的类别，节点仍然对齐
+      int __left_index = __bytes_left > 0 ? _M_floor_index(__bytes_left) : -1;
       if (__bytes_left > 0) {
-        //* 定位到该剩余空间所对应 chunk 块大小的链表指针
-        _Obj *volatile * __my_free_list =
-            _S_free_list + _S_freelist_index(__bytes_left);
-        //* 将该空间转化为对应的 chunk 节点，并将该节点头指针指向链表头结点
-        ((_Obj *)_S_start_free) -> _M_free_list_link = *__my_free_list;
-        //* 接着将 _S_start_free 转化的 _Obj* 赋值给该链表的头节点指针
-        *__my_free_list = (_Obj*)_S_start_free;
-        //* 此时，该大小 chunk 对应的链表头结点(_Obj*)指向的是备用内存池中的 (_Obj*)_S_start_free
+        //* 舍弃的零头记在所属 chunk 上，trim 判断 chunk 是否完全空闲时计入
+        long unsigned int __waste = __bytes_left - (__left_index >= 0 ? _SizeClass::_S_size(__left_index) : 0);
+        if (__waste > 0) _M_chunk_of(_M_end_free - 1) -> _M_wasted += __waste;
       }
-      //* malloc 开辟所有 chunk 块(20 * 2 = 40块)，首地址赋值给 _S_start_free
-      _S_start_free = (char *)malloc(__bytes_to_get);
+      if (__left_index >= 0) {
+        //* 将该空间转化为对应的 chunk 节点，压入该剩余空间所对应 chunk 块大小的链表
+        //* 此时，该大小 chunk 对应的链表头结点(_Obj*)指向的是备用内存池中的 (_Obj*)_M_start_free
+        _M_push_chain(__left_index, (_Obj *)_M_start_free, (_Obj *)_M_start_free);
+      }
+      //* malloc 开辟所有 chunk 块(20 * 2 = 40块)，首地址赋值给 _M_start_free
+      _M_start_free = _M_new_chunk(__bytes_to_get, false);
       //* malloc 开辟失败
-      if (0 == _S_start_free) {
+      if (0 == _M_start_free) {
         long unsigned int __i;
-        //* 二级指针用于遍历链表的指针数组
-        _Obj *volatile * __my_free_list;
+        long unsigned int __class_size;
         _Obj *__p;
         // Try to make do with what we have.  That can't
         // hurt.  We do not try smaller requests, since that tends
         // to result in disaster on multi-process machines.
         //* 遍历指针数组中从当前 size 大小的元素开始到最后的所有元素(因为 size 之前的 chunk 块放不下size大小)
-        for (__i = __size;
-              __i <= (long unsigned int) _MAX_BYTES;
-              __i += (long unsigned int) _ALIGN) {
-          //* 第 i 个链表指针元素
-          __my_free_list = _S_free_list + _S_freelist_index(__i);
-          //* 准备访问第 i 个链表指针元素中的内容(chunk 块)
-          __p = *__my_free_list;
+        for (__i = _S_freelist_index(__size);
+              __i < (long unsigned int) _NFREELISTS;
+              ++__i) {
+          //* 尝试从第 i 个链表弹出头结点 chunk 块
+          __p = _M_pop_one(__i);
           if (0 != __p) {
-            //* 如果 __p 链表不为空，把链表头结点的头指针指向的下一个空闲chunk块指针赋值给链表头结点
-            *__my_free_list = __p -> _M_free_list_link;
-            //* 此时该链表原来的头结点 chunk 就可以分配给申请内存失败的 _S_start_free
-            _S_start_free = (char *)__p;
-            //* 从大小为 i 的 chunk 链表中获取了一块 chunk，所以此时_S_end_free - _S_start_free == __i
-            //* 即 _S_end_free 和 _S_start_free 维护的大小变为 i
-            _S_end_free = _S_start_free + __i;
+            __class_size = _SizeClass::_S_size(__i);
+            //* 此时该链表原来的头结点 chunk 就可以分配给申请内存失败的 _M_start_free
+            _M_start_free = (char *)__p;
+            //* 从第 i 个 chunk 链表中获取了一块 chunk，所以此时 _M_end_free - _M_start_free == __class_size
+            //* 即 _M_end_free 和 _M_start_free 维护的大小变为第 i 个类别的尺寸
+            _M_end_free = _M_start_free + __class_size;
             //* 再次递归调用时，__bytes_left >= __size，进入第二段逻辑
             //* 返回一块 __size 大小的 chunk， 备用内存块再次剩余一些未利用的空间，将该空间复用到对应大小的 chunk 链表
-            return(_S_chunk_alloc(__size, __nobjs));
+            return(_M_chunk_alloc(__size, __nobjs));
             // Any leftover piece will eventually make it to the
             // right free list.
           }
         }
         //* 如果后续所有 chunk 链表都为空，即无法从后面的 chunk 链表中分配一块对应大小的 chunk 给当前 size
-        _S_end_free = 0;	// In case of exception.
+        _M_end_free = 0;	// In case of exception.
+        //* 不允许改用 malloc 的实例直接返回失败，备用内存池保持为空
+        if (_M_can_fail) return nullptr;
         //* 再次尝试调用另外一个 allocate 函数申请内存
-        _S_start_free = (char *)malloc_alloc::allocate(__bytes_to_get);
+        _M_start_free = _M_new_chunk(__bytes_to_get, true);
         // This should either throw an
         // exception or remedy the situation.  Thus we assume it
         // succeeded.
       }
-      //* 记录内存池申请的总字节数 _S_heap_size
-      _S_heap_size += __bytes_to_get;
-      _S_end_free = _S_start_free + __bytes_to_get;
+      //* 记录内存池申请的总字节数 _M_heap_size
+      _M_heap_size += __bytes_to_get;
+      _M_end_free = _M_start_free + __bytes_to_get;
+      //* 起始地址上调到 _M_align，跳过的字节记为所属 chunk 的零头
+      char *__aligned = (char *)(((long unsigned int)_M_start_free + _M_align - 1) & ~((long unsigned int)_M_align - 1));
+      if (__aligned != _M_start_free) {
+        _M_chunk_of(_M_start_free) -> _M_wasted += __aligned - _M_start_free;
+        _M_start_free = __aligned;
+      }
       //* 递归调用，此时 大小为 __size 的所有 chunk 块都已完成开辟
-      return(_S_chunk_alloc(__size, __nobjs));
+      return(_M_chunk_alloc(__size, __nobjs));
+    }
+  }
+
+  //* 开辟一个可切分部分至少 __bytes 字节的新 chunk 并登记，返回可切分部分的起始地址
+  //* 无锁模式下优先复用 trim 留下的休眠 chunk，此时 __bytes 更新为其实际大小
+  //* 字节数按内存来源的粒度上调，多出的部分同样用于切分
+  //* __must 为 true 时内存来源开辟失败后再通过 malloc_alloc 开辟(期间暂时释放 mtx)，失败时由其 oom 处理
+  char *_M_new_chunk(long unsigned int &__bytes, bool __must) {
+#if SGI_STL_LOCK_FREE
+    for (_Chunk *__c = _M_chunks; __c != nullptr; __c = __c -> _M_next) {
+      if (__c -> _M_dormant && __c -> _M_size >= __bytes) {
+        __c -> _M_dormant = false;
+        __c -> _M_wasted = 0;
+        __bytes = __c -> _M_size;
+        return (char *)(__c + 1);
+      }
+    }
+#endif
+    PageSource *__source = _M_page_source != nullptr ? _M_page_source : mallocPageSource();
+    long unsigned int __grain = __source -> granularity();
+    long unsigned int __total = (sizeof(_Chunk) + __bytes + __grain - 1) / __grain * __grain;
+    _Chunk *__c = (_Chunk *)__source -> allocate(__total);
+    if (__c == nullptr && __must) {
+      __source = mallocPageSource();
+      __total = sizeof(_Chunk) + __bytes;
+      //* malloc 可能调用 oom 处理函数，malloc 被替换时(sgi_stl_malloc)还会重入内存池，不能持有 mtx
+      mtx.unlock();
+      __c = (_Chunk *)malloc_alloc::allocate(__total);
+      mtx.lock();
+      //* 解锁期间其他线程可能已开辟了新的备用内存池，调用者会用这个 chunk 覆盖它，剩余部分记为零头
+      if (_M_end_free != nullptr) {
+        _M_chunk_of(_M_end_free - 1) -> _M_wasted += _M_end_free - _M_start_free;
+      }
+    }
+    if (__c == nullptr) return nullptr;
+#if SGI_STL_LOCK_FREE
+    //* 地址超出 48 位时节点无法与版本号打包，继续使用会静默破坏链表
+    if (!_S_taggable(__c, __total)) {
+      fprintf(stderr, "sgi_stl: chunk %p above 48-bit address space, rebuild without SGI_STL_LOCK_FREE\n", (void *)__c);
+      abort();
+    }
+#endif
+    __bytes = __total - sizeof(_Chunk);
+    __c -> _M_next = _M_chunks;
+    __c -> _M_size = __bytes;
+    __c -> _M_wasted = 0;
+    __c -> _M_source = __source;
+    __c -> _M_dormant = false;
+    _M_chunks = __c;
+    return (char *)(__c + 1);
+  }
+
+  //* 查找地址 __p 所属的 chunk，只在切分剩余零头时调用
+  _Chunk *_M_chunk_of(char *__p) {
+    _Chunk *__c = _M_chunks;
+    while ((char *)(__c + 1) > __p || __p >= (char *)(__c + 1) + __c -> _M_size) __c = __c -> _M_next;
+    return __c;
+  }
+
+  //* 设置之后新开辟 chunk 所用的内存来源，已有的 chunk 仍归还给各自的来源
+  void _M_set_page_source(PageSource *__source) {
+    std::lock_guard<std::mutex> guard(mtx);
+    _M_page_source = __source;
+  }
+
+  //* 将完全空闲的 chunk 交还操作系统，返回交还的字节数；上层缓存中的节点视为仍在使用
+  //* 加锁模式下直接 free 掉 chunk；无锁模式下其他线程可能仍在读取栈上旧节点的 next 指针，
+  //* 因此只用 madvise(MADV_DONTNEED) 交还物理页，chunk 本身保留登记，供之后的 _M_chunk_alloc 复用
+  long unsigned int _M_trim() {
+    std::lock_guard<std::mutex> guard(mtx);
+    std::vector<_Chunk *> __chunks;
+    for (_Chunk *__c = _M_chunks; __c != nullptr; __c = __c -> _M_next) {
+      if (!__c -> _M_dormant) __chunks.push_back(__c);
+    }
+    if (__chunks.empty()) return 0;
+    std::sort(__chunks.begin(), __chunks.end());
+
+    //* 按地址找到 __p 所在 chunk 在 __chunks 中的下标
+    auto __find = [&__chunks](char *__p) -> long unsigned int {
+      return std::upper_bound(__chunks.begin(), __chunks.end(), (_Chunk *)__p) - __chunks.begin() - 1;
+    };
+
+    //* 统计每个 chunk 中空闲的字节数：链表上的节点、尚未切分的备用内存池、舍弃的零头
+    std::vector<long unsigned int> __free_bytes(__chunks.size(), 0);
+    _Obj *__lists[_NFREELISTS];
+    int __count;
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      //* 整条链表摘下来检查，无锁模式下其他线程此时看到空链表，会在 mtx 上等待本次 trim 结束
+      __lists[__i] = _M_pop_chain(__i, __INT_MAX__, __count);
+      for (_Obj *__p = __lists[__i]; __p != nullptr; __p = __p -> _M_free_list_link) {
+        __free_bytes[__find((char *)__p)] += _SizeClass::_S_size(__i);
+      }
+    }
+    if (_M_start_free != _M_end_free) {
+      __free_bytes[__find(_M_start_free)] += _M_end_free - _M_start_free;
+    }
+
+    std::vector<bool> __idle(__chunks.size(), false);
+    for (long unsigned int __k = 0; __k < __chunks.size(); ++__k) {
+      __idle[__k] = __free_bytes[__k] + __chunks[__k] -> _M_wasted == __chunks[__k] -> _M_size;
+    }
+
+    //* 把不属于空闲 chunk 的节点压回链表
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      _Obj *__head = nullptr;
+      _Obj *__tail = nullptr;
+      for (_Obj *__p = __lists[__i]; __p != nullptr; __p = __p -> _M_free_list_link) {
+        if (__idle[__find((char *)__p)]) continue;
+        if (__tail == nullptr) __head = __p; else __tail -> _M_free_list_link = __p;
+        __tail = __p;
+      }
+      if (__tail != nullptr) _M_push_chain(__i, __head, __tail);
+    }
+    if (_M_start_free != _M_end_free && __idle[__find(_M_start_free)]) {
+      _M_start_free = _M_end_free = nullptr;
+    }
+
+    //* 内存已经闲置，各类别的补充节点数回到初始值，重新慢启动
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      _M_refill_objs[__i].store(0, std::memory_order_relaxed);
+    }
+
+    long unsigned int __released = 0;
+    for (long unsigned int __k = 0; __k < __chunks.size(); ++__k) {
+      if (!__idle[__k]) continue;
+      _Chunk *__c = __chunks[__k];
+      __released += __c -> _M_size;
+      _M_heap_size -= __c -> _M_size;
+#if SGI_STL_LOCK_FREE
+      //* 只交还 chunk 内部完整的物理页，登记信息所在的页保留
+      __c -> _M_source -> release(__c + 1, __c -> _M_size);
+      __c -> _M_dormant = true;
+#else
+      _Chunk **__link = &_M_chunks;
+      while (*__link != __c) __link = &(*__link) -> _M_next;
+      *__link = __c -> _M_next;
+      __c -> _M_source -> deallocate(__c, sizeof(_Chunk) + __c -> _M_size);
+#endif
+    }
+    return __released;
+  }
+
+  //* 交还全部 chunk，包括仍被使用的节点所在的 chunk，只在不再有人使用该实例时调用
+  void _M_release() {
+    std::lock_guard<std::mutex> guard(mtx);
+    while (_M_chunks != nullptr) {
+      _Chunk *__c = _M_chunks;
+      _M_chunks = __c -> _M_next;
+      __c -> _M_source -> deallocate(__c, sizeof(_Chunk) + __c -> _M_size);
+    }
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+#if SGI_STL_LOCK_FREE
+      _M_free_list[__i].store(0, std::memory_order_relaxed);
+#else
+      _M_free_list[__i] = nullptr;
+#endif
+      _M_refill_objs[__i].store(0, std::memory_order_relaxed);
+    }
+    _M_start_free = _M_end_free = nullptr;
+    _M_heap_size = 0;
+  }
+
+  //* 填写快照中自由链表、chunk 和计数部分，上层缓存的部分由调用者补充
+  void _M_stats(pool_stats &__s) {
+    __s.classes.resize(_NFREELISTS);
+    __s.free_list_bytes = 0;
+    __s.cached_bytes = 0;
+
+    std::lock_guard<std::mutex> guard(mtx);
+    __s.heap_size = _M_heap_size;
+    __s.pool_left_bytes = _M_end_free - _M_start_free;
+    __s.chunk_count = 0;
+    for (_Chunk *__c = _M_chunks; __c != nullptr; __c = __c -> _M_next) {
+      if (!__c -> _M_dormant) ++__s.chunk_count;
+    }
+
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      pool_stats::size_class_stats &__c = __s.classes[__i];
+      __c = pool_stats::size_class_stats{_SizeClass::_S_size(__i), 0, 0, 0, 0, 0, 0};
+      __c.refill_objects = _M_refill_count(__i);
+
+      //* 摘下整条链表计数后原样压回，无锁模式下遍历正在被并发修改的栈并不安全
+      int __count;
+      _Obj *__head = _M_pop_chain(__i, __INT_MAX__, __count);
+      if (__head != nullptr) {
+        _Obj *__tail = __head;
+        while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+        _M_push_chain(__i, __head, __tail);
+      }
+      __c.free_objects = __count;
+      __s.free_list_bytes += __count * __c.size;
+
+#if SGI_STL_STATS
+      __c.hits = _M_hits[__i].load(std::memory_order_relaxed);
+      __c.misses = _M_misses[__i].load(std::memory_order_relaxed);
+      __c.refills = _M_refills[__i].load(std::memory_order_relaxed);
+#endif
     }
   }
 
    //* 自由链表的指针数组，存放每个自由链表的起始地址
-  static _Obj *volatile _S_free_list[_NFREELISTS];
+#if SGI_STL_LOCK_FREE
+  std::atomic<unsigned long> _M_free_list[_NFREELISTS] = {};  //* 无锁模式下为带版本号的栈顶
+#else
+  _Obj *volatile _M_free_list[_NFREELISTS] = {};
+#endif
+
+  std::mutex mtx;   //* 保证链表的线程安全；无锁模式下只保护 _M_refill/_M_chunk_alloc 的慢速路径
+
+  unsigned int _M_align = _ALIGN;  //* 节点的对齐字节数，2 的幂
+  bool _M_single_class = false;    //* 只开辟一个类别(sgi_stl_malloc 每个类别一个实例)，切分剩余的零头直接舍弃，不放入其他类别的链表
+  bool _M_can_fail = false;        //* 内存来源开辟失败时不改用 malloc_alloc，_M_allocate 返回 nullptr；只用于直接调用 _M_allocate 的实例
+
+  char  *_M_start_free = nullptr;  //* 备用内存池起始地址
+  char  *_M_end_free = nullptr;    //* 备用内存池末尾地址
+  long unsigned int _M_heap_size = 0;         //* 内存池申请的总字节数
+  _Chunk *_M_chunks = nullptr;     //* 内存池持有的所有 chunk，由 mtx 保护
+  PageSource *_M_page_source = nullptr;  //* 开辟新 chunk 的内存来源，为空时使用 malloc，由 mtx 保护
+  std::atomic<int> _M_refill_objs[_NFREELISTS] = {};  //* 各类别下次 _M_refill 切分的节点数，0 表示尚未开始
+
+#if SGI_STL_STATS
+  std::atomic<unsigned long> _M_hits[_NFREELISTS] = {};     //* 自由链表命中次数及已退出线程的命中次数
+  std::atomic<unsigned long> _M_misses[_NFREELISTS] = {};   //* 自由链表未命中次数及已退出线程的未命中次数
+  std::atomic<unsigned long> _M_refills[_NFREELISTS] = {};  //* 切分新内存补充链表的次数
+#endif
+};
+
+//* 所有 Allocator<T, _SizeClass> 共用的全局内存池：一个 __pool_engine 实例加上线程缓存或每 CPU 缓存
+template <typename _SizeClass>
+class __global_pool {
+  typedef __pool_engine<_SizeClass> _Engine;
+  typedef typename _Engine::_Obj _Obj;
+  typedef typename _Engine::_Free_list_lock _Free_list_lock;
+
+public:
+  enum { _MAX_BYTES = _Engine::_MAX_BYTES };
+  enum { _NFREELISTS = _Engine::_NFREELISTS };
+
+  static long unsigned int _S_freelist_index(long unsigned int __bytes) {
+    return _Engine::_S_freelist_index(__bytes);
+  }
+
+  //* 按字节数开辟内存，小块内存优先从线程本地缓存中取
+  static void *_S_allocate(long unsigned int __n) {
+    //* 如果申请的不是小块内存(> 128 bytes)，仍采用默认的空间配置器(malloc、free管理)
+    if (__n > (long unsigned int) _MAX_BYTES) {
+      return malloc_alloc::allocate(__n);
+    }
+
+    long unsigned int __index = _S_freelist_index(__n);
+#if SGI_STL_THREAD_CACHE
+    _Thread_cache &__cache = _S_thread_cache;
+    _Obj *__result = __cache._M_free_list[__index];
+    //* 快速路径：直接从本线程的链表头取一个节点，无需加锁
+    if (__result != nullptr) {
+      __cache._M_free_list[__index] = __result -> _M_free_list_link;
+      --__cache._M_count[__index];
+      __SGI_STL_STAT(_S_stat_add_local(__cache._M_hits[__index], 1));
+      return __result;
+    }
+    //* 本线程缓存为空，从全局自由链表批量补充
+    return _S_cache_refill(__cache, __index);
+#elif SGI_STL_PER_CPU
+    _Cpu_arena &__arena = _S_arena();
+    //* 只有同一 CPU 上的线程会竞争这把锁，通常只是一次无竞争的原子操作
+    std::lock_guard<std::mutex> __guard(__arena._M_lock);
+    _Obj *__result = __arena._M_free_list[__index];
+    if (__result != nullptr) {
+      __arena._M_free_list[__index] = __result -> _M_free_list_link;
+      --__arena._M_count[__index];
+      __SGI_STL_STAT(++__arena._M_hits[__index]);
+      return __result;
+    }
+    return _S_arena_refill(__arena, __index);
+#else
+    return _S_engine._M_allocate(__index);
+#endif
+  }
+
+  //* 按字节数释放内存，小块内存优先归还到线程本地缓存
+  static void _S_deallocate(void *__p, long unsigned int __n) {
+    //* 如果归还的内存大小大于128字节，说明不是内存池申请的，而是 malloc，所以应 free
+    if (__n > (long unsigned int) _MAX_BYTES) {
+      malloc_alloc::deallocate(__p, __n);
+      return;
+    }
+
+    long unsigned int __index = _S_freelist_index(__n);
+#if SGI_STL_REMOTE_FREE
+    _Thread_cache &__cache = _S_thread_cache;
+    _Obj *__q = (_Obj *)__p;
+    _Heap *__owner = _S_segment_of(__p) -> _M_owner;
+    //* 本线程堆切分出的节点直接挂回本线程缓存，不与其他线程交还
+    if (__owner == __cache._M_heap && !__cache._M_released) {
+      __q -> _M_free_list_link = __cache._M_free_list[__index];
+      __cache._M_free_list[__index] = __q;
+      //* 与普通线程缓存一样以 _CACHE_LIMIT 批为上限，多出的一批压回本线程堆的队列
+      int __batch = _SizeClass::_S_batch(__index);
+      if (++__cache._M_count[__index] > _CACHE_LIMIT * __batch) {
+        _S_cache_spill(__cache, __index, __batch);
+      }
+      return;
+    }
+    //* 其他线程的节点压入其所属堆的队列，只写所属堆的队列头，不碰本线程缓存
+    __owner -> _M_push_remote(__index, __q, __q);
+#elif SGI_STL_THREAD_CACHE
+    _Thread_cache &__cache = _S_thread_cache;
+    //* 线程退出阶段缓存已经交还，直接归还到全局自由链表
+    if (__cache._M_released) {
+      _S_engine._M_deallocate(__p, __index);
+      return;
+    }
+    _Obj *__q = (_Obj *)__p;
+    //* 只释放不开辟的线程从未走过 refill，向空链表挂入第一个节点时登记，线程退出时才会交还，trim/stats 也能看到
+    if (__cache._M_free_list[__index] == nullptr) _S_cache_register(__cache);
+    __q -> _M_free_list_link = __cache._M_free_list[__index];
+    __cache._M_free_list[__index] = __q;
+    //* 本线程缓存的空闲块过多时，将一批节点交还全局自由链表，供其他线程使用
+    int __batch = _SizeClass::_S_batch(__index);
+    if (++__cache._M_count[__index] > _CACHE_LIMIT * __batch) {
+      _S_cache_flush(__cache, __index, __batch);
+    }
+#elif SGI_STL_PER_CPU
+    _Obj *__q = (_Obj *)__p;
+    _Cpu_arena &__arena = _S_arena();
+    std::lock_guard<std::mutex> __guard(__arena._M_lock);
+    __q -> _M_free_list_link = __arena._M_free_list[__index];
+    __arena._M_free_list[__index] = __q;
+    int __batch = _SizeClass::_S_batch(__index);
+    if (++__arena._M_count[__index] > _ARENA_LIMIT * __batch) {
+      _S_arena_flush(__arena, __index, __batch);
+    }
+#else
+    _S_engine._M_deallocate(__p, __index);
+#endif
+  }
+
+  //* 按 __align 字节对齐开辟 __n 字节内存，__align 为 2 的幂
+  //* 不超过 8 字节的对齐走普通路径；更大的对齐由对应的对齐实例提供，不经过线程缓存；
+  //* 没有合适类别(超过 _MAX_BYTES 或对齐超过 _MAX_ALIGN)时用 posix_memalign
+  static void *_S_allocate_aligned(long unsigned int __n, long unsigned int __align) {
+    if (__align <= (long unsigned int) _Engine::_ALIGN) return _S_allocate(__n);
+    _Engine *__engine = _S_aligned_engine(__align);
+    int __index = __engine != nullptr ? __engine -> _M_index(__n) : -1;
+    if (__index >= 0) return __engine -> _M_allocate(__index);
+
+    void *__result = nullptr;
+    if (posix_memalign(&__result, __align, __n == 0 ? __align : __n) != 0) { __THROW_BAD_ALLOC; }
+    return __result;
+  }
+
+  //* 释放 _S_allocate_aligned 开辟的内存，__n 和 __align 须与开辟时一致
+  static void _S_deallocate_aligned(void *__p, long unsigned int __n, long unsigned int __align) {
+    if (__align <= (long unsigned int) _Engine::_ALIGN) {
+      _S_deallocate(__p, __n);
+      return;
+    }
+    _Engine *__engine = _S_aligned_engine(__align);
+    int __index = __engine != nullptr ? __engine -> _M_index(__n) : -1;
+    if (__index >= 0) {
+      __engine -> _M_deallocate(__p, __index);
+      return;
+    }
+    free(__p);
+  }
+
+  //* 批量开辟 __n 个 __bytes 大小的内存块，地址依次写入 __out
+  //* 先取本线程(或本 CPU)缓存中的节点，不足部分加锁一次从全局自由链表整段摘取，仍不足再直接切分 chunk
+  static void _S_allocate_batch(long unsigned int __bytes, long unsigned int __n, void **__out) {
+    long unsigned int __i = 0;
+    if (__bytes > (long unsigned int) _MAX_BYTES) {
+      for (; __i < __n; ++__i) __out[__i] = malloc_alloc::allocate(__bytes);
+      return;
+    }
+
+    long unsigned int __index = _S_freelist_index(__bytes);
+#if SGI_STL_THREAD_CACHE
+    _Thread_cache &__cache = _S_thread_cache;
+    _Obj *__p = __cache._M_free_list[__index];
+    for (; __i < __n && __p != nullptr; ++__i) {
+      __out[__i] = __p;
+      __p = __p -> _M_free_list_link;
+    }
+    __cache._M_free_list[__index] = __p;
+    __cache._M_count[__index] -= (int)__i;
+#elif SGI_STL_PER_CPU
+    {
+      _Cpu_arena &__arena = _S_arena();
+      std::lock_guard<std::mutex> __guard(__arena._M_lock);
+      _Obj *__p = __arena._M_free_list[__index];
+      for (; __i < __n && __p != nullptr; ++__i) {
+        __out[__i] = __p;
+        __p = __p -> _M_free_list_link;
+      }
+      __arena._M_free_list[__index] = __p;
+      __arena._M_count[__index] -= (int)__i;
+    }
+#endif
+#if SGI_STL_REMOTE_FREE
+    //* 全局自由链表上的节点不属于任何线程的堆，不足部分仍从本线程的堆中取
+    for (; __i < __n; ++__i) __out[__i] = _S_allocate(__bytes);
+#endif
+    if (__i < __n) {
+      for (_Obj *__q = _S_engine._M_fetch_chain(__index, __n - __i); __q != nullptr; __q = __q -> _M_free_list_link) {
+        __out[__i++] = __q;
+      }
+    }
+  }
 
-  static std::mutex mtx;   //* 保证链表的线程安全
+  //* 批量释放 __n 个 __bytes 大小的内存块
+  //* 在锁外把它们串成一段，再加锁一次(无锁模式下一次 CAS)整段压回全局自由链表
+  static void _S_deallocate_batch(long unsigned int __bytes, void **__ptrs, long unsigned int __n) {
+    if (__n == 0) return;
+    if (__bytes > (long unsigned int) _MAX_BYTES) {
+      for (long unsigned int __i = 0; __i < __n; ++__i) malloc_alloc::deallocate(__ptrs[__i], __bytes);
+      return;
+    }
+#if SGI_STL_REMOTE_FREE
+    //* 各节点可能属于不同线程的堆，逐个交还所属的堆
+    for (long unsigned int __i = 0; __i < __n; ++__i) _S_deallocate(__ptrs[__i], __bytes);
+#else
+    for (long unsigned int __i = 0; __i + 1 < __n; ++__i) {
+      ((_Obj *)__ptrs[__i]) -> _M_free_list_link = (_Obj *)__ptrs[__i + 1];
+    }
+    long unsigned int __index = _S_freelist_index(__bytes);
+    _S_engine._M_refill_shrink(__index);
+    _Free_list_lock __lock(_S_engine);
+    _S_engine._M_push_chain(__index, (_Obj *)__ptrs[0], (_Obj *)__ptrs[__n - 1]);
+#endif
+  }
+
+  //* 为本线程预留 __n 个 __bytes 大小的内存块，未启用线程缓存时挂在全局自由链表上；
+  //* 每 CPU 缓存模式下同样挂在全局链表上，线程随时可能迁移到其他 CPU，放进当前 CPU 的缓存没有意义
+  static void _S_reserve(long unsigned int __bytes, long unsigned int __n) {
+    if (__n == 0 || __bytes > (long unsigned int) _MAX_BYTES) return;
+
+    long unsigned int __index = _S_freelist_index(__bytes);
+#if SGI_STL_REMOTE_FREE
+    //* 直接从本线程的堆中切分；线程退出阶段不再预留
+    _Thread_cache &__cache = _S_thread_cache;
+    if (__cache._M_released) return;
+    _S_cache_register(__cache);
+    while (__n > 0) {
+      int __count = 0;
+      _Obj *__chain = _S_heap_carve(*__cache._M_heap, __index, __n > 4096 ? 4096 : (int)__n, __count);
+      _Obj *__tail = __chain;
+      while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+      __tail -> _M_free_list_link = __cache._M_free_list[__index];
+      __cache._M_free_list[__index] = __chain;
+      __cache._M_count[__index] += __count;
+      __n -= __count;
+    }
+#else
+    _Obj *__head = _S_engine._M_fetch_chain(__index, __n);
+    _Obj *__tail = __head;
+    while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+#if SGI_STL_THREAD_CACHE
+    _Thread_cache &__cache = _S_thread_cache;
+    if (!__cache._M_released) {
+      _S_cache_register(__cache);
+      __tail -> _M_free_list_link = __cache._M_free_list[__index];
+      __cache._M_free_list[__index] = __head;
+      __cache._M_count[__index] += (int)__n;
+      return;
+    }
+#endif
+    _Free_list_lock __lock(_S_engine);
+    _S_engine._M_push_chain(__index, __head, __tail);
+#endif
+  }
+
+  //* 先归还调用线程的缓存(每 CPU 缓存模式下为所有 CPU 的缓存)，再交还完全空闲的 chunk
+  //* 其他线程缓存中的节点视为仍在使用，它们所在的 chunk 不会被交还
+  static long unsigned int _S_trim() {
+    _S_cache_release_all();
+    long unsigned int __released = _S_engine._M_trim();
+    for (_Engine &__engine : _S_aligned) __released += __engine._M_trim();
+    return __released;
+  }
+
+  static pool_stats _S_stats() {
+    pool_stats __s;
+    _S_engine._M_stats(__s);
+#if SGI_STL_REMOTE_FREE
+    //* 各线程堆的段只计入总量，段内尚未切分的部分和队列中的节点不单独统计
+    long unsigned int __segments = _S_segment_count.load(std::memory_order_relaxed);
+    __s.heap_size += __segments * _SEGMENT_SIZE;
+    __s.chunk_count += __segments;
+#endif
+#if SGI_STL_STATS
+    std::lock_guard<std::mutex> guard(_S_engine.mtx);
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      pool_stats::size_class_stats &__c = __s.classes[__i];
+#if SGI_STL_THREAD_CACHE
+      for (_Thread_cache *__t = _S_caches; __t != nullptr; __t = __t -> _M_next_cache) {
+        __c.hits += __t -> _M_hits[__i].load(std::memory_order_relaxed);
+        __c.misses += __t -> _M_misses[__i].load(std::memory_order_relaxed);
+        __c.cached_objects += __atomic_load_n(&__t -> _M_count[__i], __ATOMIC_RELAXED);
+      }
+#elif SGI_STL_PER_CPU
+      const _Cpu_arenas &__all = _S_all_arenas();
+      for (unsigned int __k = 0; __k < __all._M_count; ++__k) {
+        const _Cpu_arena &__arena = __all._M_arenas[__k];
+        __c.hits += __atomic_load_n(&__arena._M_hits[__i], __ATOMIC_RELAXED);
+        __c.misses += __atomic_load_n(&__arena._M_misses[__i], __ATOMIC_RELAXED);
+        __c.cached_objects += __atomic_load_n(&__arena._M_count[__i], __ATOMIC_RELAXED);
+      }
+#endif
+      __s.cached_bytes += __c.cached_objects * __c.size;
+    }
+#endif
+    return __s;
+  }
+
+  static void _S_set_page_source(PageSource *__source) {
+    _S_engine._M_set_page_source(__source);
+    for (_Engine &__engine : _S_aligned) __engine._M_set_page_source(__source);
+  }
+
+  static void _S_set_trim_interval(std::chrono::milliseconds __interval) {
+    _S_trim_thread._M_start(__interval);
+  }
+
+private:
+#if SGI_STL_THREAD_CACHE
+  //* 线程缓存与全局自由链表之间每次搬运 _SizeClass::_S_batch 个节点
+  enum { _CACHE_LIMIT = 3 };  //* 线程缓存单个链表最多保留的空闲节点数，以批量搬运个数为单位
+
+  //* 线程本地缓存，每个线程持有一份与全局自由链表同构的链表数组，读写无需加锁
+  //* 只包含平凡成员，线程访问时不需要额外的初始化检查
+  struct _Heap;
+
+  struct _Thread_cache {
+    _Obj *_M_free_list[_NFREELISTS];  //* 本线程的自由链表
+    int _M_count[_NFREELISTS];        //* 每个链表中的空闲节点数
+    bool _M_registered;               //* 是否已登记线程退出时的回收
+    bool _M_released;                 //* 线程退出时缓存已交还全局自由链表
+#if SGI_STL_REMOTE_FREE
+    _Heap *_M_heap;                   //* 本线程的堆，登记时取得
+#endif
+#if SGI_STL_STATS
+    //* 只由本线程写入，用 relaxed 读加写累加，不产生带锁前缀的指令；stats() 从其他线程读取
+    std::atomic<unsigned long> _M_hits[_NFREELISTS];    //* 本线程缓存命中次数
+    std::atomic<unsigned long> _M_misses[_NFREELISTS];  //* 本线程缓存未命中次数
+    _Thread_cache *_M_next_cache;     //* 已登记的线程缓存串成链表，由 mtx 保护
+#endif
+  };
+
+  //* 线程退出时析构，将本线程缓存的空闲节点全部交还全局自由链表
+  struct _Thread_cache_guard {
+    ~_Thread_cache_guard() {
+      _Thread_cache &__cache = _S_thread_cache;
+#if SGI_STL_STATS
+      {
+        //* 线程退出时把本线程的计数并入全局计数，并从登记链表中摘除
+        std::lock_guard<std::mutex> guard(_S_engine.mtx);
+        for (int __i = 0; __i < _NFREELISTS; ++__i) {
+          _S_engine._M_hits[__i].fetch_add(__cache._M_hits[__i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+          _S_engine._M_misses[__i].fetch_add(__cache._M_misses[__i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        _Thread_cache **__link = &_S_caches;
+        while (*__link != &__cache) __link = &(*__link) -> _M_next_cache;
+        *__link = __cache._M_next_cache;
+      }
+#endif
+#if SGI_STL_REMOTE_FREE
+      //* 缓存中的节点都属于本线程的堆，压回堆自己的队列后把堆交给之后启动的线程接管
+      _Heap *__heap = __cache._M_heap;
+      for (int __i = 0; __i < _NFREELISTS; ++__i) {
+        _Obj *__head = __cache._M_free_list[__i];
+        if (__head == nullptr) continue;
+        _Obj *__tail = __head;
+        while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+        __heap -> _M_push_remote(__i, __head, __tail);
+        __cache._M_free_list[__i] = nullptr;
+        __cache._M_count[__i] = 0;
+      }
+      {
+        std::lock_guard<std::mutex> guard(_S_engine.mtx);
+        __heap -> _M_next_abandoned = _S_abandoned;
+        _S_abandoned = __heap;
+      }
+      __cache._M_released = true;
+      return;
+#endif
+      _Free_list_lock __lock(_S_engine);
+      for (int __i = 0; __i < _NFREELISTS; ++__i) {
+        _Obj *__head = __cache._M_free_list[__i];
+        if (__head == nullptr) continue;
+        _Obj *__tail = __head;
+        while (__tail -> _M_free_list_link != nullptr) {
+          __tail = __tail -> _M_free_list_link;
+        }
+        _S_engine._M_push_chain(__i, __head, __tail);
+        __cache._M_free_list[__i] = nullptr;
+        __cache._M_count[__i] = 0;
+      }
+      __cache._M_released = true;
+    }
+  };
+
+  //* 首次走慢速路径时 odr-use 守卫对象，使其在线程退出时析构
+  static void _S_cache_register(_Thread_cache &__cache) {
+    if (!__cache._M_registered) {
+      static thread_local _Thread_cache_guard __guard;
+      (void)__guard;
+      __cache._M_registered = true;
+#if SGI_STL_REMOTE_FREE
+      __cache._M_heap = _S_heap_acquire();
+#endif
+#if SGI_STL_STATS
+      std::lock_guard<std::mutex> guard(_S_engine.mtx);
+      __cache._M_next_cache = _S_caches;
+      _S_caches = &__cache;
+#endif
+    }
+  }
+
+  //* 本线程缓存为空时，一次从全局自由链表取出一批节点，返回其中一个，其余留在本线程缓存
+  static void *_S_cache_refill(_Thread_cache &__cache, long unsigned int __index) {
+#if SGI_STL_REMOTE_FREE
+    if (__cache._M_released) {
+      //* 本线程的堆已交出，线程退出阶段的零星申请由公用的孤儿堆加锁提供
+      std::lock_guard<std::mutex> guard(_S_engine.mtx);
+      int __count = 0;
+      _Obj *__result = _S_heap_fetch(_S_orphan, __index, 1, __count);
+      if (__result -> _M_free_list_link != nullptr) {
+        _Obj *__tail = __result -> _M_free_list_link;
+        while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+        _S_orphan._M_push_remote(__index, __result -> _M_free_list_link, __tail);
+      }
+      return __result;
+    }
+    _S_cache_register(__cache);
+    __SGI_STL_STAT(_S_stat_add_local(__cache._M_misses[__index], 1));
+
+    //* 先取回其他线程释放的节点，队列为空时再从本线程的段中切分一批
+    int __count = 0;
+    _Obj *__chain = _S_heap_fetch(*__cache._M_heap, __index, _SizeClass::_S_batch(__index), __count);
+    __cache._M_free_list[__index] = __chain -> _M_free_list_link;
+    __cache._M_count[__index] = __count - 1;
+    return __chain;
+#else
+    if (__cache._M_released) {
+      return _S_engine._M_allocate(__index);
+    }
+    _S_cache_register(__cache);
+    __SGI_STL_STAT(_S_stat_add_local(__cache._M_misses[__index], 1));
+
+    //* 一次从全局链表头部整段摘下至多 _S_batch 个节点，第一个分配出去，其余交给本线程缓存
+    int __count = 0;
+    _Obj *__chain = _S_engine._M_pop_batch(__index, _SizeClass::_S_batch(__index), __count);
+    __cache._M_free_list[__index] = __chain -> _M_free_list_link;
+    __cache._M_count[__index] = __count - 1;
+    return __chain;
+#endif
+  }
+
+  //* 将本线程缓存中第 __index 个链表头部的 __nobjs 个节点整段交还全局自由链表
+  static void _S_cache_flush(_Thread_cache &__cache, long unsigned int __index, int __nobjs) {
+    _Obj *__head = __cache._M_free_list[__index];
+    _Obj *__tail = __head;
+    //* 在锁外摘下要交还的这一段
+    for (int __i = 1; __i < __nobjs; ++__i) {
+      __tail = __tail -> _M_free_list_link;
+    }
+    __cache._M_free_list[__index] = __tail -> _M_free_list_link;
+    __cache._M_count[__index] -= __nobjs;
+    //* 本线程用不完而整批交还，说明该类别不再紧缺
+    _S_engine._M_refill_shrink(__index);
+
+    _Free_list_lock __lock(_S_engine);
+    _S_engine._M_push_chain(__index, __head, __tail);
+  }
+
+  static thread_local _Thread_cache _S_thread_cache;  //* 本线程的自由链表缓存
+
+#if SGI_STL_REMOTE_FREE
+  //* 生产者/消费者场景下一个线程分配、另一个线程释放，普通线程缓存中节点会单向流向释放方，
+  //* 释放方缓存满后加全局锁交还，分配方缓存空后再加全局锁取回，每次释放都在竞争同一把锁
+  //* 这里每个线程拥有一个堆，小块内存只从自己堆的段(按 _SEGMENT_SIZE 对齐)中切分，
+  //* 段头记录所属的堆，释放时由地址直接求出所属的堆：
+  //* 属于本线程则挂回本线程缓存；属于其他线程则压入该堆对应类别的多生产者单消费者队列，
+  //* 所属线程在缓存为空的慢速路径上从队列中取回至多 _CACHE_LIMIT 批，释放方从不写分配方的缓存
+  //* 线程退出后它的堆登记为无主，由之后启动的线程接管，队列中的节点随之回到使用中；
+  //* 段不交还操作系统，trim 只作用于全局实例和对齐实例
+  //* 段的大小和对齐：不小于 64KB 且至少容纳 16 个最大的内存块的 2 的幂
+  enum : long unsigned int {
+    _SEGMENT_SIZE = 16UL * _MAX_BYTES <= (1UL << 16) ? (1UL << 16) : 1UL << (64 - __builtin_clzl(16UL * _MAX_BYTES - 1))
+  };
+
+  //* 段头，独占一个缓存行，之后的部分用于切分
+  struct alignas(64) _Segment {
+    _Heap *_M_owner;  //* 所属的堆，开辟后不再改变
+  };
+
+  //* 线程的堆：其他线程释放的节点按类别各排一个队列，当前段中尚未切分的部分只由所属线程访问
+  struct alignas(64) _Heap {
+    std::atomic<_Obj *> _M_remote[_NFREELISTS] = {};  //* 其他线程释放回来的节点，无锁栈
+    char *_M_start_free = nullptr;    //* 当前段中尚未切分部分的起始地址
+    char *_M_end_free = nullptr;      //* 当前段的末尾地址
+    _Heap *_M_next_abandoned = nullptr;  //* 无主的堆串成链表，由 _S_engine.mtx 保护
+
+    //* 将 [__head, __tail] 整段压入第 __index 个队列，任何线程都可以调用
+    //* 只有所属线程会取出，且总是整条取走，不存在 ABA 问题
+    void _M_push_remote(long unsigned int __index, _Obj *__head, _Obj *__tail) {
+      _Obj *__top = _M_remote[__index].load(std::memory_order_relaxed);
+      do {
+        __tail -> _M_free_list_link = __top;
+      } while (!_M_remote[__index].compare_exchange_weak(__top, __head, std::memory_order_release,
+                                                         std::memory_order_relaxed));
+    }
+  };
+
+  static _Segment *_S_segment_of(void *__p) {
+    return (_Segment *)((long unsigned int)__p & ~((long unsigned int)_SEGMENT_SIZE - 1));
+  }
+
+  //* 优先接管已退出线程留下的堆，没有时新建一个；新建的堆永不释放，其他线程随时可能向它交还节点
+  static _Heap *_S_heap_acquire() {
+    {
+      std::lock_guard<std::mutex> guard(_S_engine.mtx);
+      if (_S_abandoned != nullptr) {
+        _Heap *__heap = _S_abandoned;
+        _S_abandoned = __heap -> _M_next_abandoned;
+        return __heap;
+      }
+    }
+    return new _Heap();
+  }
+
+  //* 从 __heap 的当前段中切分至多 __batch 个第 __index 类的节点，串成链表返回，__count 为实际个数
+  //* 当前段不够一个节点时，把零头放入能容纳的最大类别的队列，再开辟一个新段
+  static _Obj *_S_heap_carve(_Heap &__heap, long unsigned int __index, int __batch, int &__count) {
+    long unsigned int __size = _SizeClass::_S_size(__index);
+    long unsigned int __left = __heap._M_end_free - __heap._M_start_free;
+    if (__left < __size) {
+      int __left_index = __left > 0 ? _SizeClass::_S_floor_index(__left) : -1;
+      if (__left_index >= 0) {
+        _Obj *__q = (_Obj *)__heap._M_start_free;
+        __heap._M_push_remote(__left_index, __q, __q);
+      }
+      void *__mem = nullptr;
+      if (posix_memalign(&__mem, _SEGMENT_SIZE, _SEGMENT_SIZE) != 0) { __THROW_BAD_ALLOC; }
+      _Segment *__seg = (_Segment *)__mem;
+      __seg -> _M_owner = &__heap;
+      __heap._M_start_free = (char *)(__seg + 1);
+      __heap._M_end_free = (char *)__seg + _SEGMENT_SIZE;
+      __left = __heap._M_end_free - __heap._M_start_free;
+      _S_segment_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    __count = __left / __size < (long unsigned int) __batch ? (int)(__left / __size) : __batch;
+    _Obj *__result = (_Obj *)__heap._M_start_free;
+    for (int __i = 0; __i < __count; ++__i) {
+      _Obj *__q = (_Obj *)(__heap._M_start_free + __i * __size);
+      __q -> _M_free_list_link = __i + 1 < __count ? (_Obj *)((char *)__q + __size) : nullptr;
+    }
+    __heap._M_start_free += __count * __size;
+    __SGI_STL_STAT(_S_engine._M_refills[__index].fetch_add(1, std::memory_order_relaxed));
+    return __result;
+  }
+
+  //* 从第 __index 个队列中至多取 _CACHE_LIMIT * __batch 个节点，其余整段压回队列；
+  //* 队列为空时从段中切分至多 __batch 个，返回链表和个数
+  static _Obj *_S_heap_fetch(_Heap &__heap, long unsigned int __index, int __batch, int &__count) {
+    _Obj *__chain = __heap._M_remote[__index].exchange(nullptr, std::memory_order_acquire);
+    if (__chain == nullptr) return _S_heap_carve(__heap, __index, __batch, __count);
+    _Obj *__last = __chain;
+    __count = 1;
+    while (__count < _CACHE_LIMIT * __batch && __last -> _M_free_list_link != nullptr) {
+      __last = __last -> _M_free_list_link;
+      ++__count;
+    }
+    _Obj *__rest = __last -> _M_free_list_link;
+    if (__rest != nullptr) {
+      __last -> _M_free_list_link = nullptr;
+      _Obj *__tail = __rest;
+      while (__tail -> _M_free_list_link != nullptr) __tail = __tail -> _M_free_list_link;
+      __heap._M_push_remote(__index, __rest, __tail);
+    }
+    return __chain;
+  }
+
+  //* 将本线程缓存中第 __index 个链表头部的 __nobjs 个节点压回本线程堆的队列，留给之后的慢速路径取回
+  //* 段中的节点只能回到所属的堆，不交还全局自由链表
+  static void _S_cache_spill(_Thread_cache &__cache, long unsigned int __index, int __nobjs) {
+    _Obj *__head = __cache._M_free_list[__index];
+    _Obj *__tail = __head;
+    for (int __i = 1; __i < __nobjs; ++__i) __tail = __tail -> _M_free_list_link;
+    __cache._M_free_list[__index] = __tail -> _M_free_list_link;
+    __cache._M_count[__index] -= __nobjs;
+    __cache._M_heap -> _M_push_remote(__index, __head, __tail);
+  }
+
+  static _Heap *_S_abandoned;  //* 线程退出后留下的堆，由 _S_engine.mtx 保护
+  static _Heap _S_orphan;      //* 线程退出阶段的申请使用的公用堆，由 _S_engine.mtx 保护
+  static std::atomic<long unsigned int> _S_segment_count;  //* 各堆开辟的段数
+#endif
+#endif
+
+#if SGI_STL_PER_CPU
+  //* 每个 CPU 一份与线程缓存同构的自由链表数组，各自一把锁，全局 mtx 只在补充和交还时使用
+  //* 运行在同一 CPU 上的线程轮流使用同一份缓存，线程数再多，缓存的总量也只随 CPU 个数增长
+  //* 内核支持 rseq 时直接读取内核维护的 rseq 区域中的 cpu_id，否则调用 sched_getcpu
+  //* 真正的可重启临界区需要按架构手写汇编，这里仍用每 CPU 一把锁保证正确：
+  //* 读到 CPU 编号后线程可能被迁移，此时只是与另一个线程短暂竞争同一把锁
+  enum { _ARENA_LIMIT = 3 };  //* 每个 CPU 缓存单个链表最多保留的空闲节点数，以批量搬运个数为单位
+
+  struct alignas(64) _Cpu_arena {
+    std::mutex _M_lock;               //* 保护本 CPU 的自由链表
+    _Obj *_M_free_list[_NFREELISTS] = {};
+    int _M_count[_NFREELISTS] = {};
+#if SGI_STL_STATS
+    unsigned long _M_hits[_NFREELISTS] = {};    //* 本 CPU 缓存命中次数，由 _M_lock 保护
+    unsigned long _M_misses[_NFREELISTS] = {};  //* 本 CPU 缓存未命中次数，由 _M_lock 保护
+#endif
+  };
+
+  struct _Cpu_arenas {
+    _Cpu_arena *_M_arenas;
+    unsigned int _M_count;
+  };
+
+  //* 按配置的 CPU 个数一次建好，之后不再释放
+  static const _Cpu_arenas &_S_all_arenas() {
+    static const _Cpu_arenas __all = [] {
+      long __n = sysconf(_SC_NPROCESSORS_CONF);
+      unsigned int __count = __n > 0 ? (unsigned int)__n : 1;
+      return _Cpu_arenas{new _Cpu_arena[__count], __count};
+    }();
+    return __all;
+  }
+
+  //* 当前线程所在的 CPU
+  static unsigned int _S_current_cpu() {
+#ifdef RSEQ_SIG
+    if (__rseq_size > 0) {
+      const struct rseq *__rs = (const struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset);
+      int __cpu = (int)__atomic_load_n(&__rs -> cpu_id, __ATOMIC_RELAXED);
+      if (__cpu >= 0) return (unsigned int)__cpu;
+    }
+#endif
+    int __cpu = sched_getcpu();
+    return __cpu >= 0 ? (unsigned int)__cpu : 0;
+  }
+
+  static _Cpu_arena &_S_arena() {
+    const _Cpu_arenas &__all = _S_all_arenas();
+    return __all._M_arenas[_S_current_cpu() % __all._M_count];
+  }
+
+  //* 本 CPU 缓存为空时，从全局自由链表取一批节点，调用者持有 __arena._M_lock
+  //* 锁的顺序总是先 CPU 缓存再 mtx
+  static void *_S_arena_refill(_Cpu_arena &__arena, long unsigned int __index) {
+    __SGI_STL_STAT(++__arena._M_misses[__index]);
+    int __count = 0;
+    _Obj *__chain = _S_engine._M_pop_batch(__index, _SizeClass::_S_batch(__index), __count);
+    __arena._M_free_list[__index] = __chain -> _M_free_list_link;
+    __arena._M_count[__index] = __count - 1;
+    return __chain;
+  }
+
+  //* 将本 CPU 缓存中第 __index 个链表头部的 __nobjs 个节点交还全局自由链表，调用者持有 __arena._M_lock
+  static void _S_arena_flush(_Cpu_arena &__arena, long unsigned int __index, int __nobjs) {
+    _Obj *__head = __arena._M_free_list[__index];
+    _Obj *__tail = __head;
+    for (int __i = 1; __i < __nobjs; ++__i) {
+      __tail = __tail -> _M_free_list_link;
+    }
+    __arena._M_free_list[__index] = __tail -> _M_free_list_link;
+    __arena._M_count[__index] -= __nobjs;
+    _S_engine._M_refill_shrink(__index);
+
+    _Free_list_lock __lock(_S_engine);
+    _S_engine._M_push_chain(__index, __head, __tail);
+  }
+#endif
+
+  //* 归还本线程缓存(或所有 CPU 缓存)中的全部节点，trim 前调用，使这些节点也能计入空闲
+  static void _S_cache_release_all() {
+#if SGI_STL_REMOTE_FREE
+    //* 缓存中的节点只能回到所属的堆，不交还全局自由链表
+#elif SGI_STL_THREAD_CACHE
+    _Thread_cache &__cache = _S_thread_cache;
+    for (int __i = 0; __i < _NFREELISTS; ++__i) {
+      if (__cache._M_count[__i] > 0) _S_cache_flush(__cache, __i, __cache._M_count[__i]);
+    }
+#elif SGI_STL_PER_CPU
+    //* 每 CPU 缓存不属于任何线程，全部交还
+    const _Cpu_arenas &__all = _S_all_arenas();
+    for (unsigned int __k = 0; __k < __all._M_count; ++__k) {
+      _Cpu_arena &__arena = __all._M_arenas[__k];
+      std::lock_guard<std::mutex> __guard(__arena._M_lock);
+      for (int __i = 0; __i < _NFREELISTS; ++__i) {
+        if (__arena._M_count[__i] > 0) _S_arena_flush(__arena, __i, __arena._M_count[__i]);
+      }
+    }
+#endif
+  }
+
+  //* 后台回收线程：按设定的间隔周期性调用 trim，进程退出时随静态对象析构而停止
+  struct _Trim_thread {
+    std::thread _M_thread;
+    std::mutex _M_mtx;
+    std::condition_variable _M_cond;
+    std::chrono::milliseconds _M_interval{0};
+
+    void _M_start(std::chrono::milliseconds __interval) {
+      _M_stop();
+      if (__interval.count() <= 0) return;
+      _M_interval = __interval;
+      _M_thread = std::thread([this] {
+        std::unique_lock<std::mutex> __lock(_M_mtx);
+        while (!_M_cond.wait_for(__lock, _M_interval, [this] { return _M_interval.count() == 0; })) {
+          __lock.unlock();
+          _S_trim();
+          __lock.lock();
+        }
+      });
+    }
+
+    void _M_stop() {
+      if (!_M_thread.joinable()) return;
+      {
+        std::lock_guard<std::mutex> __lock(_M_mtx);
+        _M_interval = std::chrono::milliseconds(0);
+      }
+      _M_cond.notify_one();
+      _M_thread.join();
+    }
+
+    ~_Trim_thread() { _M_stop(); }
+  };
+
+  static _Trim_thread _S_trim_thread;
+
+  //* 常量初始化且析构为平凡操作，进程退出阶段仍可安全使用
+  static _Engine _S_engine;
+
+  //* 对齐要求为 16、32、...、_MAX_ALIGN 字节的对齐实例，第 __k 个对齐到 16 << __k 字节
+  enum { _MAX_ALIGN = 4096 };
+  enum { _NALIGNED = 9 };
+  static _Engine _S_aligned[_NALIGNED];
+
+  static _Engine *_S_aligned_engine(long unsigned int __align) {
+    int __k = __builtin_ctzl(__align) - 4;
+    return __k < (int) _NALIGNED ? &_S_aligned[__k] : nullptr;
+  }
 
-  static char  *_S_start_free;  //* 备用内存池起始地址
-  static char  *_S_end_free;    //* 备用内存池末尾地址
-  static long unsigned int _S_heap_size;         //* 内存池申请的总字节数
+#if SGI_STL_STATS
+  //* 只有一个线程写入的计数器，relaxed 读加写即可
+  static void _S_stat_add_local(std::atomic<unsigned long> &__counter, unsigned long __n) {
+    __counter.store(__counter.load(std::memory_order_relaxed) + __n, std::memory_order_relaxed);
+  }
+
+#if SGI_STL_THREAD_CACHE
+  static _Thread_cache *_S_caches;  //* 所有已登记的线程缓存，由 _S_engine.mtx 保护
+#endif
+#endif
 };
 
-template <typename T>
-char *Allocator<T>::_S_start_free = nullptr;
+template <typename _SizeClass>
+__pool_engine<_SizeClass> __global_pool<_SizeClass>::_S_engine;
+
+template <typename _SizeClass>
+__pool_engine<_SizeClass> __global_pool<_SizeClass>::_S_aligned[_NALIGNED] = {
+  __pool_engine<_SizeClass>(16),   __pool_engine<_SizeClass>(32),   __pool_engine<_SizeClass>(64),
+  __pool_engine<_SizeClass>(128),  __pool_engine<_SizeClass>(256),  __pool_engine<_SizeClass>(512),
+  __pool_engine<_SizeClass>(1024), __pool_engine<_SizeClass>(2048), __pool_engine<_SizeClass>(4096)
+};
+
+template <typename _SizeClass>
+typename __global_pool<_SizeClass>::_Trim_thread __global_pool<_SizeClass>::_S_trim_thread;
+
+#if SGI_STL_THREAD_CACHE
+template <typename _SizeClass>
+thread_local typename __global_pool<_SizeClass>::_Thread_cache __global_pool<_SizeClass>::_S_thread_cache;
+
+#if SGI_STL_STATS
+template <typename _SizeClass>
+typename __global_pool<_SizeClass>::_Thread_cache *__global_pool<_SizeClass>::_S_caches = nullptr;
+#endif
+
+#if SGI_STL_REMOTE_FREE
+template <typename _SizeClass>
+typename __global_pool<_SizeClass>::_Heap *__global_pool<_SizeClass>::_S_abandoned = nullptr;
+
+template <typename _SizeClass>
+typename __global_pool<_SizeClass>::_Heap __global_pool<_SizeClass>::_S_orphan;
+
+template <typename _SizeClass>
+std::atomic<long unsigned int> __global_pool<_SizeClass>::_S_segment_count{0};
+#endif
+#endif
+
+template<typename T, typename _SizeClass = default_size_class>
+class Allocator {
+  typedef __global_pool<_SizeClass> _Pool;
+
+public:
+  using value_type = T;
+
+  constexpr Allocator() noexcept {}
+  constexpr Allocator(const Allocator &) noexcept = default;
+  template <class _Other>
+  constexpr Allocator(const Allocator<_Other, _SizeClass> &) noexcept {}
+
+  //* 内存开辟，__n 为对象个数；alignof(T) 超过 8 时按 alignof(T) 对齐
+  T *allocate(long unsigned int __n) {
+    if (alignof(T) > (long unsigned int) _ALIGN) {
+      return (T *)_Pool::_S_allocate_aligned(__n * sizeof(T), alignof(T));
+    }
+    return (T *)_Pool::_S_allocate(__n * sizeof(T));
+  }
+
+  //* 内存释放，__n 为对象个数，须与 allocate 时一致
+  void deallocate(void *__p, long unsigned int __n) {
+    if (alignof(T) > (long unsigned int) _ALIGN) {
+      _Pool::_S_deallocate_aligned(__p, __n * sizeof(T), alignof(T));
+      return;
+    }
+    _Pool::_S_deallocate(__p, __n * sizeof(T));
+  }
+
+  //* 按指定对齐开辟 __bytes 字节，__align 为 2 的幂，例如给 AVX 缓冲区传 32 或 64
+  void *allocate_bytes(long unsigned int __bytes, long unsigned int __align = alignof(T)) {
+    return _Pool::_S_allocate_aligned(__bytes, __align);
+  }
+
+  //* 释放 allocate_bytes 开辟的内存，__bytes 和 __align 须与开辟时一致
+  void deallocate_bytes(void *__p, long unsigned int __bytes, long unsigned int __align = alignof(T)) {
+    _Pool::_S_deallocate_aligned(__p, __bytes, __align);
+  }
+
+  //* 批量开辟 __n 个单对象大小的内存块，地址依次写入 __out，返回开辟的个数
+  //* 先取本线程缓存中的节点，不足部分加锁一次从全局自由链表整段摘取，仍不足再直接切分 chunk
+  long unsigned int allocate_batch(long unsigned int __n, T **__out) {
+    if (alignof(T) > (long unsigned int) _ALIGN) {
+      for (long unsigned int __i = 0; __i < __n; ++__i) __out[__i] = allocate(1);
+      return __n;
+    }
+    _Pool::_S_allocate_batch(sizeof(T), __n, (void **)__out);
+    return __n;
+  }
+
+  //* 批量释放 __n 个由 allocate(1) 或 allocate_batch 开辟的内存块
+  //* 在锁外把它们串成一段，再加锁一次(无锁模式下一次 CAS)整段压回全局自由链表
+  void deallocate_batch(T **__ptrs, long unsigned int __n) {
+    if (alignof(T) > (long unsigned int) _ALIGN) {
+      for (long unsigned int __i = 0; __i < __n; ++__i) deallocate(__ptrs[__i], 1);
+      return;
+    }
+    _Pool::_S_deallocate_batch(sizeof(T), (void **)__ptrs, __n);
+  }
 
-template <typename T>
-char *Allocator<T>::_S_end_free = nullptr;
+  //* 为本线程预留 __n 个单对象大小的内存块，之后逐个 allocate(1) 时直接命中无锁快速路径
+  //* 未启用线程缓存时，预留的内存块挂在全局自由链表上；对齐超过 8 字节的类型不做预留
+  static void reserve(long unsigned int __n) {
+    if (alignof(T) > (long unsigned int) _ALIGN) return;
+    _Pool::_S_reserve(sizeof(T), __n);
+  }
 
-template <typename T>
-long unsigned int Allocator<T>::_S_heap_size = 0;
+  //* 内存扩容/缩容，__old_sz 和 __new_sz 为字节数
+  void *reallocate(void *__p, long unsigned int __old_sz, long unsigned int __new_sz) {
+    void *__result;
+    long unsigned int __copy_sz;
 
-template <typename T>
-typename Allocator<T>::_Obj *volatile Allocator<T>::_S_free_list[_NFREELISTS] = {nullptr, nullptr, nullptr, nullptr, nullptr,
-  nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+    //* alignof(T) 超过 8 时内存来自对齐实例或 posix_memalign，realloc 和普通链表都不能保证对齐
+    if (alignof(T) > (long unsigned int) _ALIGN) {
+      if (__old_sz == __new_sz) return(__p);
+      __result = _Pool::_S_allocate_aligned(__new_sz, alignof(T));
+      memcpy(__result, __p, __new_sz > __old_sz ? __old_sz : __new_sz);
+      _Pool::_S_deallocate_aligned(__p, __old_sz, alignof(T));
+      return(__result);
+    }
+    //* 如果内存不是从内存池开辟的，直接调用 realloc
+    if (__old_sz > (long unsigned int) _MAX_BYTES && __new_sz > (long unsigned int) _MAX_BYTES) {
+      return(realloc(__p, __new_sz));
+    }
+    //* 如果新旧尺寸映射到同一个尺寸类别，不用扩容或者缩容，直接返回
+    if (__old_sz <= (long unsigned int) _MAX_BYTES && __new_sz <= (long unsigned int) _MAX_BYTES &&
+        _Pool::_S_freelist_index(__old_sz) == _Pool::_S_freelist_index(__new_sz)) {
+      return(__p);
+    }
+    //* 以新尺寸开辟内存
+    __result = _Pool::_S_allocate(__new_sz);
+    //* 扩容就 copy __old_sz，缩容就 copy __new_sz
+    __copy_sz = __new_sz > __old_sz ? __old_sz : __new_sz;
+    memcpy(__result, __p, __copy_sz);
+    //* 归还 __old_sz chunk块
+    _Pool::_S_deallocate(__p, __old_sz);
+    return(__result);
+  }
 
-template <typename T>
-std::mutex Allocator<T>::mtx;
+  //* 将完全空闲的 chunk 交还操作系统，返回交还的字节数
+  //* 先归还调用线程的缓存；其他线程缓存中的节点视为仍在使用，它们所在的 chunk 不会被交还
+  //* 每 CPU 缓存模式下先归还所有 CPU 的缓存
+  //* 加锁模式下直接 free 掉 chunk；无锁模式下只用 madvise(MADV_DONTNEED) 交还物理页，chunk 保留供之后复用
+  //* 同一尺寸类别策略下的所有 Allocator<T> 共用一个内存池，对任意 T 调用效果相同
+  static long unsigned int trim() {
+    return _Pool::_S_trim();
+  }
+
+  //* 内存池当前状态的快照，命中、未命中、补充次数和线程缓存中的节点数需要开启 SGI_STL_STATS
+  static pool_stats stats() {
+    return _Pool::_S_stats();
+  }
+
+  //* 设置之后新开辟 chunk 所用的内存来源(malloc、mmap、透明大页)，已有的 chunk 仍归还给各自的来源
+  static void set_page_source(PageSource *__source) {
+    _Pool::_S_set_page_source(__source);
+  }
+
+  //* 后台回收策略：每隔 __interval 在后台线程中调用一次 trim，传入 0 则停止
+  static void set_trim_interval(std::chrono::milliseconds __interval) {
+    _Pool::_S_set_trim_interval(__interval);
+  }
+
+  //* 对象构造
+  void construct(T *__p, const T &val) {
+    new (__p) T(val);
+  }
+  //* 对象析构
+  void destory(T *__p) {
+    __p->~T();
+  }
+
+private:
+  enum { _ALIGN = __pool_engine<_SizeClass>::_ALIGN };    //* 普通路径保证的对齐字节数
+  enum { _MAX_BYTES = _SizeClass::_S_max_bytes };         //* 内存池最大的 chunk 块
+};
+
+//* 所有 Allocator 共用同一个全局内存池，任意两个实例都可以互相释放对方开辟的内存
+template <typename T, typename U, typename _SizeClass>
+bool operator==(const Allocator<T, _SizeClass> &, const Allocator<U, _SizeClass> &) noexcept {
+  return true;
+}
+
+template <typename T, typename U, typename _SizeClass>
+bool operator!=(const Allocator<T, _SizeClass> &, const Allocator<U, _SizeClass> &) noexcept {
+  return false;
+}
+
+//* 以 std::pmr::memory_resource 的形式使用全局内存池，与 Allocator 共用同一组自由链表和线程缓存
+//* 对齐要求超过 8 字节的申请由全局内存池的对齐实例提供
+template <typename _SizeClass>
+class __global_pool_resource : public std::pmr::memory_resource {
+  typedef __global_pool<_SizeClass> _Pool;
+
+protected:
+  void *do_allocate(size_t __bytes, size_t __align) override {
+    return _Pool::_S_allocate_aligned(__bytes == 0 ? 1 : __bytes, __align);
+  }
+
+  void do_deallocate(void *__p, size_t __bytes, size_t __align) override {
+    _Pool::_S_deallocate_aligned(__p, __bytes == 0 ? 1 : __bytes, __align);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &__other) const noexcept override {
+    return this == &__other;
+  }
+};
+
+//* 全局内存池对应的 memory_resource，进程内唯一，从不析构
+//* 例：std::pmr::vector<int> v(sgi_stl::global_pool_resource());
+template <typename _SizeClass = default_size_class>
+std::pmr::memory_resource *global_pool_resource() {
+  static __global_pool_resource<_SizeClass> *__resource = new __global_pool_resource<_SizeClass>;
+  return __resource;
+}
+
+//* 独立的自由链表内存池，持有自己的 __pool_engine，可以按子系统划分、随对象一起销毁
+//* 不经过线程缓存，每次申请都访问本实例的自由链表(加锁模式下加 mtx，无锁模式下 CAS)
+//* 超过 _MAX_BYTES 或对齐要求超过 8 字节的申请转交给上游 memory_resource
+//* 析构或 release() 时交还全部 chunk，之前从本实例开辟的小块内存随之失效
+template <typename _SizeClass = default_size_class>
+class pool_resource : public std::pmr::memory_resource {
+  typedef __pool_engine<_SizeClass> _Engine;
+
+public:
+  explicit pool_resource(std::pmr::memory_resource *__upstream = std::pmr::get_default_resource(),
+                         PageSource *__source = nullptr)
+      : _M_upstream(__upstream) {
+    _M_engine._M_set_page_source(__source);
+  }
+
+  pool_resource(const pool_resource &) = delete;
+  pool_resource &operator=(const pool_resource &) = delete;
+
+  ~pool_resource() override { release(); }
+
+  //* 交还全部 chunk；转交给上游的大块内存由使用者各自释放
+  void release() { _M_engine._M_release(); }
+
+  //* 将完全空闲的 chunk 交还内存来源，返回交还的字节数
+  long unsigned int trim() { return _M_engine._M_trim(); }
+
+  pool_stats stats() {
+    pool_stats __s;
+    _M_engine._M_stats(__s);
+    return __s;
+  }
+
+  std::pmr::memory_resource *upstream_resource() const { return _M_upstream; }
+
+protected:
+  void *do_allocate(size_t __bytes, size_t __align) override {
+    if (__bytes > (size_t) _Engine::_MAX_BYTES || __align > (size_t) _Engine::_ALIGN) {
+      return _M_upstream -> allocate(__bytes, __align);
+    }
+    return _M_engine._M_allocate(_Engine::_S_freelist_index(__bytes == 0 ? 1 : __bytes));
+  }
+
+  void do_deallocate(void *__p, size_t __bytes, size_t __align) override {
+    if (__bytes > (size_t) _Engine::_MAX_BYTES || __align > (size_t) _Engine::_ALIGN) {
+      _M_upstream -> deallocate(__p, __bytes, __align);
+      return;
+    }
+    _M_engine._M_deallocate(__p, _Engine::_S_freelist_index(__bytes == 0 ? 1 : __bytes));
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &__other) const noexcept override {
+    return this == &__other;
+  }
+
+private:
+  _Engine _M_engine;
+  std::pmr::memory_resource *_M_upstream;
+};
 
 } //* namespace sgi_stl
-#endif
\ No newline at end of file
+#endif
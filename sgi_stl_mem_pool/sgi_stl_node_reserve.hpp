@@ -0,0 +1,58 @@
+#ifndef SGI_STL_NODE_RESERVE
+#define SGI_STL_NODE_RESERVE
+#include "sgi_stl_mem_pool.hpp"
+#include <forward_list>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+
+namespace sgi_stl {
+
+//* 节点型容器通过 rebind 向分配器申请的节点类型
+//* 与 SGI STL 中 list/rb_tree 的 simple_alloc<_Node, _Alloc> 对应，这里是 libstdc++ 的节点类型
+template <typename _Container>
+struct __container_node;
+
+template <typename _Tp, typename _Alloc>
+struct __container_node<std::list<_Tp, _Alloc>> {
+  typedef std::_List_node<_Tp> type;
+};
+
+template <typename _Tp, typename _Alloc>
+struct __container_node<std::forward_list<_Tp, _Alloc>> {
+  typedef std::_Fwd_list_node<_Tp> type;
+};
+
+template <typename _Key, typename _Tp, typename _Compare, typename _Alloc>
+struct __container_node<std::map<_Key, _Tp, _Compare, _Alloc>> {
+  typedef std::_Rb_tree_node<std::pair<const _Key, _Tp>> type;
+};
+
+template <typename _Key, typename _Tp, typename _Compare, typename _Alloc>
+struct __container_node<std::multimap<_Key, _Tp, _Compare, _Alloc>> {
+  typedef std::_Rb_tree_node<std::pair<const _Key, _Tp>> type;
+};
+
+template <typename _Key, typename _Compare, typename _Alloc>
+struct __container_node<std::set<_Key, _Compare, _Alloc>> {
+  typedef std::_Rb_tree_node<_Key> type;
+};
+
+template <typename _Key, typename _Compare, typename _Alloc>
+struct __container_node<std::multiset<_Key, _Compare, _Alloc>> {
+  typedef std::_Rb_tree_node<_Key> type;
+};
+
+//* 为使用 Allocator 的节点型容器预留 __n 个节点
+//* 节点由 allocate_batch 的同一路径一次取出并放入本线程缓存，随后 __n 次插入不再进入慢速路径
+//* 例：std::map<int, int, std::less<int>, Allocator<std::pair<const int, int>>> m; reserve_nodes(m, 1000000);
+template <typename _Container>
+void reserve_nodes(const _Container &, long unsigned int __n) {
+  typedef typename std::allocator_traits<typename _Container::allocator_type>::template
+      rebind_alloc<typename __container_node<_Container>::type> _Node_alloc;
+  _Node_alloc::reserve(__n);
+}
+
+} //* namespace sgi_stl
+#endif
@@ -1,8 +1,29 @@
 #include "./ngx_mem_pool.hpp"
+#include "ngx_array.hpp"
+#include "ngx_buf.hpp"
+#include "ngx_slab.hpp"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return false;                                                   \
+    }                                                                 \
+  } while (0)
 
 typedef struct Data stData;
 struct Data {
@@ -21,20 +42,20 @@ void func2(void *pf) {
   fclose(pf1);
 }
 
-int main() {
+static bool testExample() {
   // 512 - sizeof(ngx_pool_t) - 4095   =>   max
   NgxMemPool pool(512);
 
   void *p1 = pool.ngxPalloc(128); // 从小块内存池分配的
   if (p1 == NULL) {
     printf("ngx_palloc 128 bytes fail...\n");
-    return -1;
+    return false;
   }
 
   stData *p2 = (stData *)pool.ngxPalloc(512); // 从大块内存池分配的
   if (p2 == NULL) {
     printf("ngx_palloc 512 bytes fail...\n");
-    return -1;
+    return false;
   }
 
   //* 大块内存中的对象指向了外部资源
@@ -51,5 +72,905 @@ int main() {
   c2->data_ = p2->pfile;
 
   // pool.ngxDestoryPool(); // 1.调用所有的预置的清理函数 2.释放大块内存 3.释放小块内存池所有内存
-  return 0;
+  return true;
+}
+
+static void countCleanup(void *data) {
+  ++*(int *)data;
+}
+
+//* 回滚释放保存之后的大块内存(进入尺寸桶缓存)，只执行保存之后登记的清理，
+//* 跨越保存之后追加的内存块恢复 current_、last_ 和 failed_
+static bool testRollback() {
+  NgxMemPool pool(4096);
+  pool.ngxSetLargeCache(1 << 20);
+  int before = 0, after = 0;
+
+  void *keep = pool.ngxPalloc(8192);
+  NgxPoolCleanup *c = pool.ngxCleanupAdd(0);
+  c->handler_ = countCleanup;
+  c->data_ = &before;
+  NgxPoolStats marked = pool.ngxStats();
+
+  NgxPoolMark mark = pool.ngxMark();
+  CHECK(mark != nullptr);
+  //* 追加足够多的内存块，使 failed_ 超过上限、current_ 前移
+  for (int i = 0; i < 32; ++i) {
+    CHECK(pool.ngxPalloc(3000) != nullptr);
+  }
+  CHECK(pool.ngxStats().blockCount_ > marked.blockCount_);
+  void *l1 = pool.ngxPalloc(8192);
+  void *l2 = pool.ngxPalloc(20000);
+  CHECK(l1 != nullptr && l2 != nullptr);
+  c = pool.ngxCleanupAdd(0);
+  c->handler_ = countCleanup;
+  c->data_ = &after;
+  CHECK(pool.ngxStats().largeCount_ == 3);
+
+  pool.ngxRollback(mark);
+  CHECK(after == 1);
+  CHECK(before == 0);
+  NgxPoolStats rolled = pool.ngxStats();
+  CHECK(rolled.largeCount_ == 1);
+  CHECK(rolled.largeCachedCount_ == 2);
+  for (size_t i = 0; i < marked.failed_.size(); ++i) {
+    CHECK(rolled.failed_[i] == marked.failed_[i]);
+  }
+  for (size_t i = marked.failed_.size(); i < rolled.failed_.size(); ++i) {
+    CHECK(rolled.failed_[i] == 0);
+  }
+  //* 保存点本身也被收回，下一次小块分配从它的位置开始
+  CHECK(pool.ngxPalloc(64) == (void *)mark);
+
+  //* 回滚释放的大块内存从尺寸桶中复用，保存之前的大块内存仍可释放
+  void *l3 = pool.ngxPalloc(8192);
+  CHECK(l3 == l1);
+  CHECK(pool.ngxStats().largeCachedCount_ == 1);
+  pool.ngxPfree(keep);
+  CHECK(pool.ngxStats().largeCount_ == 1);
+
+  //* 作用域守卫
+  {
+    NgxPoolScope<NgxMemPool> scope(pool);
+    CHECK(pool.ngxPalloc(100000) != nullptr);
+    CHECK(pool.ngxStats().largeCount_ == 2);
+  }
+  CHECK(pool.ngxStats().largeCount_ == 1);
+  return true;
+}
+
+//* 大于 NGX_ALIGNMENT 的对齐：大块内存按对齐后的地址登记，ngxPfree 和两种分配器的释放都能交还
+static bool testAlignedLarge() {
+  NgxMemPool pool(4096);
+  for (size_t align : {(size_t)64, (size_t)4096}) {
+    void *p = pool.ngxPallocAligned(10000, align);
+    CHECK(p != nullptr);
+    CHECK((uintptr_t)p % align == 0);
+    memset(p, 0xab, 10000);
+    CHECK(pool.ngxStats().largeCount_ == 1);
+    pool.ngxPfree(p);
+    CHECK(pool.ngxStats().largeCount_ == 0);
+  }
+
+  //* 小块内存同样对齐，释放什么也不做
+  void *s = pool.ngxPallocAligned(100, 256);
+  CHECK((uintptr_t)s % 256 == 0);
+  CHECK(!pool.ngxIsLarge(100));
+
+  //* 尺寸桶缓存中取回的大块内存同样对齐
+  pool.ngxSetLargeCache(1 << 20);
+  void *a = pool.ngxPallocAligned(10000, 128);
+  pool.ngxPfree(a);
+  CHECK(pool.ngxStats().largeCachedCount_ == 1);
+  void *b = pool.ngxPallocAligned(10000, 128);
+  CHECK((uintptr_t)b % 128 == 0);
+  CHECK(pool.ngxStats().largeCachedCount_ == 0);
+  pool.ngxPfree(b);
+
+  //* 容器扩容时旧的大块内存交还，同时持有的只有当前这一块
+  struct alignas(64) Line {
+    char data_[64];
+  };
+  {
+    NgxPoolResource<NgxMemPool> resource(pool);
+    std::pmr::vector<Line> v(&resource);
+    for (int i = 0; i < 1000; ++i) {
+      v.push_back(Line());
+      CHECK((uintptr_t)v.data() % 64 == 0);
+      CHECK(pool.ngxStats().largeCount_ <= 1);
+    }
+  }
+  CHECK(pool.ngxStats().largeCount_ == 0);
+  {
+    std::vector<Line, NgxPoolAllocator<Line>> v{NgxPoolAllocator<Line>(pool)};
+    for (int i = 0; i < 1000; ++i) {
+      v.push_back(Line());
+      CHECK(pool.ngxStats().largeCount_ <= 1);
+    }
+  }
+  CHECK(pool.ngxStats().largeCount_ == 0);
+  return true;
+}
+
+//* 大量大块内存同时登记在散列表中，按交错的顺序 ngxPfree：
+//* 删除时后移补位，之后的每一块仍能找到并释放，重复释放和外来地址什么也不做
+static bool testLargeHashErase() {
+  const int kBlocks = 1000;
+  NgxMemPool pool(4096);
+  std::vector<u_char *> blocks;
+  for (int i = 0; i < kBlocks; ++i) {
+    size_t n = 5000 + (size_t)(i % 7) * 1000;
+    u_char *p = (u_char *)pool.ngxPalloc(n);
+    CHECK(p != nullptr);
+    p[0] = (u_char)i;
+    blocks.push_back(p);
+  }
+  CHECK(pool.ngxStats().largeCount_ == (size_t)kBlocks);
+
+  size_t live = kBlocks;
+  //* 先释放每第三块，再从后往前释放奇数下标的，最后释放剩下的
+  for (int i = 0; i < kBlocks; i += 3) {
+    pool.ngxPfree(blocks[i]);
+    blocks[i] = nullptr;
+    CHECK(pool.ngxStats().largeCount_ == --live);
+  }
+  for (int i = kBlocks - 1; i >= 0; --i) {
+    if (i % 2 == 1 && blocks[i] != nullptr) {
+      pool.ngxPfree(blocks[i]);
+      blocks[i] = nullptr;
+      --live;
+    }
+  }
+  CHECK(pool.ngxStats().largeCount_ == live);
+
+  pool.ngxPfree(blocks[2]);
+  pool.ngxPfree(blocks[2]);
+  int local = 0;
+  pool.ngxPfree(&local);
+  CHECK(pool.ngxStats().largeCount_ == --live);
+  blocks[2] = nullptr;
+
+  for (int i = 0; i < kBlocks; ++i) {
+    if (blocks[i] != nullptr) {
+      CHECK(blocks[i][0] == (u_char)i);
+      pool.ngxPfree(blocks[i]);
+      CHECK(pool.ngxStats().largeCount_ == --live);
+    }
+  }
+  CHECK(live == 0);
+  return true;
+}
+
+//* 尺寸桶缓存：释放和重置时大块内存留在桶中，同一桶内的申请直接复用，调低上限时从最大的桶开始交还；
+//* 不小于 mmap 阈值的大块内存直接 mmap，释放时交还操作系统，不进入尺寸桶
+static bool testLargeBuckets() {
+  NgxMemPool pool(4096);
+  pool.ngxSetLargeCache(64 * 1024);
+  void *a = pool.ngxPalloc(5000);
+  CHECK(a != nullptr);
+  pool.ngxPfree(a);
+  NgxPoolStats stats = pool.ngxStats();
+  CHECK(stats.largeCachedCount_ == 1 && stats.largeCachedBytes_ == 5120);
+
+  //* 5100 与 5000 同属 5120 字节的桶，取回同一块
+  void *b = pool.ngxPalloc(5100);
+  CHECK(b == a);
+  CHECK(pool.ngxStats().largeCachedCount_ == 0);
+  pool.ngxPfree(b);
+  //* 6000 属于 6144 字节的桶，不复用
+  void *c = pool.ngxPalloc(6000);
+  CHECK(c != nullptr && c != b);
+  CHECK(pool.ngxStats().largeCachedCount_ == 1);
+  pool.ngxPfree(c);
+  CHECK(pool.ngxStats().largeCachedCount_ == 2);
+
+  //* 重置时持有的大块内存同样进入尺寸桶
+  for (int i = 0; i < 4; ++i) {
+    CHECK(pool.ngxPalloc(9000) != nullptr);
+  }
+  CHECK(pool.ngxStats().largeCount_ == 4);
+  pool.ngxResetPool();
+  stats = pool.ngxStats();
+  CHECK(stats.largeCount_ == 0);
+  CHECK(stats.largeCachedCount_ == 6);
+  CHECK(stats.largeCachedBytes_ == 5120 + 6144 + 4 * 10240);
+
+  //* 调低上限时先交还最大的桶
+  pool.ngxSetLargeCache(16 * 1024);
+  stats = pool.ngxStats();
+  CHECK(stats.largeCachedCount_ == 2);
+  CHECK(stats.largeCachedBytes_ == 5120 + 6144);
+  CHECK(pool.ngxTrimLargeCache() == 5120 + 6144);
+  CHECK(pool.ngxStats().largeCachedCount_ == 0);
+
+  pool.ngxSetLargeCache(1 << 20);
+  pool.ngxSetMmapThreshold(64 * 1024);
+  void *m = pool.ngxPalloc(100000);
+  CHECK(m != nullptr);
+  CHECK((uintptr_t)m % PageSource::pageSize() == 0);
+  memset(m, 0x5a, 100000);
+  pool.ngxPfree(m);
+  CHECK(pool.ngxStats().largeCachedCount_ == 0);
+  //* 阈值以下的仍进入尺寸桶
+  void *s = pool.ngxPalloc(60000);
+  CHECK(s != nullptr);
+  pool.ngxPfree(s);
+  CHECK(pool.ngxStats().largeCachedCount_ == 1);
+  //* 关闭阈值后同样大小的申请按尺寸桶开辟，释放后被缓存
+  pool.ngxSetMmapThreshold(0);
+  m = pool.ngxPalloc(100000);
+  CHECK(m != nullptr);
+  pool.ngxPfree(m);
+  CHECK(pool.ngxStats().largeCachedCount_ == 2);
+  return true;
+}
+
+//* ngxSetMaxSmall 截断到最大内存块的可用部分；开始分配之后再调用被忽略
+static bool testSetMaxSmall() {
+  NgxMemPool pool(4096);
+  pool.ngxSetBlockGrowth(16384);
+  pool.ngxSetMaxSmall(1 << 20);
+  CHECK(pool.ngxMaxSmall() == 16384 - sizeof(NgxPool));
+  pool.ngxSetMaxSmall(8000);
+  CHECK(pool.ngxMaxSmall() == 8000);
+  CHECK(!pool.ngxIsLarge(8000));
+  //* 比第一个内存块大的小块申请开辟新的内存块，不登记为大块内存
+  u_char *p = (u_char *)pool.ngxPalloc(8000);
+  CHECK(p != nullptr);
+  memset(p, 0x66, 8000);
+  CHECK(pool.ngxStats().largeCount_ == 0);
+  pool.ngxSetMaxSmall(100);
+  CHECK(pool.ngxMaxSmall() == 8000);
+
+  //* 已有清理记录或大块内存时同样忽略
+  NgxMemPool cleanup(4096);
+  size_t max = cleanup.ngxMaxSmall();
+  CHECK(cleanup.ngxCleanupAdd(0) != nullptr);
+  cleanup.ngxSetMaxSmall(100);
+  CHECK(cleanup.ngxMaxSmall() == max);
+
+  NgxMemPool large(4096);
+  void *l = large.ngxPalloc(100000);
+  CHECK(l != nullptr);
+  large.ngxSetMaxSmall(200000);
+  CHECK(large.ngxMaxSmall() == max);
+  CHECK(large.ngxIsLarge(100000));
+  large.ngxPfree(l);
+  return true;
+}
+
+//* 数组在内存块末尾时就地扩大；否则拷贝到新空间，旧的大块内存立即交还
+static bool testArrayGrowth() {
+  NgxMemPool pool(4096);
+  NgxArray<int> small(pool, 4);
+  int *first = small.ngxPush();
+  *first = 0;
+  for (int i = 1; i < 64; ++i) {
+    *small.ngxPush() = i;
+  }
+  CHECK(small.begin() == first);
+  CHECK(small.capacity() >= 64);
+
+  struct alignas(64) Line {
+    size_t v_;
+  };
+  NgxArray<Line> big(pool, 64);
+  for (size_t i = 0; i < 10000; ++i) {
+    big.ngxPush()->v_ = i;
+    CHECK((uintptr_t)big.begin() % 64 == 0);
+    CHECK(pool.ngxStats().largeCount_ <= 1);
+  }
+  for (size_t i = 0; i < big.size(); ++i) {
+    CHECK(big[i].v_ == i);
+  }
+  for (int i = 0; i < 64; ++i) {
+    CHECK(small[i] == i);
+  }
+  return true;
+}
+
+//* 把 s 拷入一个新的临时缓冲区
+static NgxChain *makeBuf(NgxMemPool &pool, const char *s, size_t size) {
+  NgxChain *cl = pool.ngxGetTempBuf(size);
+  if (cl) {
+    memcpy(cl->buf_->last_, s, strlen(s));
+    cl->buf_->last_ += strlen(s);
+  }
+  return cl;
+}
+
+//* 管道往返：拆分、限量的短写、分散到多个小缓冲区的短读、sendfile、合并和回收
+static bool testBufPipe() {
+  NgxMemPool pool(4096);
+  int fds[2];
+  CHECK(pipe(fds) == 0);
+
+  //* 一个缓冲区拆成三段，数据不拷贝
+  NgxChain *in = makeBuf(pool, "hello, pooled world", 64);
+  CHECK(in != nullptr);
+  NgxChain *mid = ngxSplitBuf(pool, in, 5);
+  CHECK(mid != nullptr && mid == in->next_);
+  NgxChain *tail = ngxSplitBuf(pool, mid, 8);
+  CHECK(tail != nullptr && tail == mid->next_);
+  CHECK(ngxSplitBuf(pool, tail, 100) == nullptr);
+  CHECK(ngxBufSize(in->buf_) == 5 && ngxBufSize(mid->buf_) == 8 && ngxBufSize(tail->buf_) == 6);
+  CHECK(ngxChainSize(in) == 19);
+
+  //* 合并是拆分的逆操作，被合并的节点进入空闲链表，下一次开辟节点直接复用
+  NgxChain *whole = makeBuf(pool, "abcdefgh", 8);
+  NgxChain *half = ngxSplitBuf(pool, whole, 3);
+  CHECK(half != nullptr);
+  ngxChainCoalesce(pool, whole);
+  CHECK(whole->next_ == nullptr);
+  CHECK(ngxBufSize(whole->buf_) == 8 && whole->buf_->end_ - whole->buf_->start_ == 8);
+  CHECK(pool.ngxAllocChainLink() == half);
+  //* 已经开始消费的缓冲区不能合并
+  half = ngxSplitBuf(pool, whole, 3);
+  half->buf_->pos_++;
+  ngxChainCoalesce(pool, whole);
+  CHECK(whole->next_ == half);
+
+  //* limit 造成的短写停在第二段中间
+  NgxChain *rest = ngxWriteChain(fds[1], in, 7);
+  CHECK(rest == mid);
+  CHECK(ngxBufSize(mid->buf_) == 6);
+  CHECK(ngxWriteChain(fds[1], rest, 0) == nullptr);
+  CHECK(ngxChainSize(in) == 0);
+
+  //* 文件缓冲区走 sendfile
+  FILE *f = tmpfile();
+  CHECK(f != nullptr);
+  fputs("0123456789", f);
+  fflush(f);
+  NgxBuf *fb = (NgxBuf *)pool.ngxPcalloc(sizeof(NgxBuf));
+  fb->inFile_ = 1;
+  fb->fd_ = fileno(f);
+  fb->filePos_ = 2;
+  fb->fileLast_ = 6;
+  NgxChain fcl = {fb, nullptr};
+  CHECK(ngxWriteChain(fds[1], &fcl, 0) == nullptr);
+  CHECK(fb->filePos_ == 6);
+  fclose(f);
+
+  //* 读入两个 8 字节的缓冲区：第一次受 limit 限制只读 3 字节，之后填满第一个再进入第二个
+  NgxChain *r1 = pool.ngxGetTempBuf(8);
+  NgxChain *r2 = pool.ngxGetTempBuf(16);
+  r1->next_ = r2;
+  CHECK(ngxReadvChain(fds[0], r1, 3) == 3);
+  CHECK(ngxReadvChain(fds[0], r1, 0) == 20);
+  CHECK(memcmp(r1->buf_->pos_, "hello, p", 8) == 0);
+  CHECK(memcmp(r2->buf_->pos_, "ooled world2345", 15) == 0);
+
+  //* 对端关闭后读到 0
+  close(fds[1]);
+  CHECK(ngxReadvChain(fds[0], r2, 0) == 0);
+  close(fds[0]);
+
+  //* 回收的缓冲区按容量复用，游标复位
+  u_char *mem = r2->buf_->start_;
+  pool.ngxRecycleChain(r1);
+  NgxChain *again = pool.ngxGetTempBuf(12);
+  CHECK(again == r2);
+  CHECK(again->buf_->start_ == mem && again->buf_->pos_ == mem && again->buf_->last_ == mem);
+  CHECK(pool.ngxGetTempBuf(8) == r1);
+  return true;
+}
+
+//* 非阻塞 socketpair：写满时 ngxWriteChain 返回未写完的节点，读空时 ngxReadvChain 返回 -1/EAGAIN，
+//* 交替读写直到数据全部按序到达
+static bool testBufSocketpair() {
+  NgxMemPool pool(4096);
+  int fds[2];
+  CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  CHECK(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+  CHECK(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+  u_char byte;
+  NgxBuf one = {};
+  one.start_ = one.pos_ = one.last_ = &byte;
+  one.end_ = &byte + 1;
+  NgxChain probe = {&one, nullptr};
+  CHECK(ngxReadvChain(fds[0], &probe, 0) == -1 && errno == EAGAIN);
+
+  //* 8 个 512KB 的缓冲区共 4MB，远超套接字缓冲区
+  const size_t kBuf = 512 * 1024, kBufs = 8;
+  NgxChain *out = nullptr, **ll = &out;
+  size_t seq = 0;
+  for (size_t i = 0; i < kBufs; ++i) {
+    NgxChain *cl = pool.ngxGetTempBuf(kBuf);
+    CHECK(cl != nullptr);
+    for (size_t j = 0; j < kBuf; ++j) {
+      *cl->buf_->last_++ = (u_char)(seq++ * 7);
+    }
+    *ll = cl;
+    ll = &cl->next_;
+  }
+
+  NgxChain *rd = pool.ngxGetTempBuf(100000);
+  size_t got = 0;
+  bool blocked = false;
+  NgxChain *pending = out;
+  while (got < kBuf * kBufs) {
+    if (pending) {
+      pending = ngxWriteChain(fds[1], pending, 0);
+      CHECK(pending != NGX_CHAIN_ERROR);
+      blocked = blocked || pending != nullptr;
+    }
+    for (;;) {
+      rd->buf_->pos_ = rd->buf_->last_ = rd->buf_->start_;
+      ssize_t n = ngxReadvChain(fds[0], rd, 0);
+      if (n == -1) {
+        CHECK(errno == EAGAIN);
+        break;
+      }
+      CHECK(n > 0);
+      for (ssize_t j = 0; j < n; ++j, ++got) {
+        CHECK(rd->buf_->pos_[j] == (u_char)(got * 7));
+      }
+    }
+  }
+  CHECK(blocked);
+  CHECK(pending == nullptr);
+  CHECK(ngxChainSize(out) == 0);
+  close(fds[0]);
+  close(fds[1]);
+  return true;
+}
+
+//* 子进程的检查结果通过退出码带回
+static bool runChild(bool (*fn)(void *), void *arg) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    _exit(fn(arg) ? 0 : 1);
+  }
+  int status = 0;
+  return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+struct SlabShared {
+  NgxSlabPool *pool_;
+  size_t offs_[64];              //* 父进程开辟的地址，以偏移的形式交给子进程
+  size_t noffs_;
+};
+
+static bool childFreeAll(void *arg) {
+  SlabShared *sh = (SlabShared *)arg;
+  for (size_t i = 0; i < sh->noffs_; ++i) {
+    sh->pool_->ngxSlabFree(sh->pool_->ngxSlabAddr(sh->offs_[i]));
+  }
+  return true;
+}
+
+static bool childDieLocked(void *arg) {
+  ((SlabShared *)arg)->pool_->ngxSlabLock();
+  _exit(0);
+}
+
+//* 父进程开辟、子进程释放，整页释放后相邻空闲页合并；持锁的子进程崩溃后父进程仍能加锁
+static bool testSlabFork() {
+  const size_t size = 1 << 20;
+  void *shm = ngxShmAlloc(nullptr, size, true);
+  CHECK(shm != nullptr);
+  NgxSlabPool *pool = NgxSlabPool::ngxSlabInit(shm, size);
+  CHECK(pool != nullptr);
+  size_t pages = pool->ngxSlabFreePages();
+  SlabShared *sh = (SlabShared *)pool->ngxSlabCalloc(sizeof(SlabShared));
+  CHECK(sh != nullptr);
+  sh->pool_ = pool;
+
+  for (size_t i = 0; i < 40; ++i) {
+    void *p = pool->ngxSlabAlloc(i % 2 ? 24 : 200);
+    CHECK(p != nullptr);
+    memset(p, 0x5a, i % 2 ? 24 : 200);
+    sh->offs_[sh->noffs_++] = pool->ngxSlabOffset(p);
+  }
+  for (size_t n = 1; n <= 3; ++n) {
+    void *p = pool->ngxSlabAlloc(n * NGX_SLAB_PAGE_SIZE);
+    CHECK(p != nullptr);
+    sh->offs_[sh->noffs_++] = pool->ngxSlabOffset(p);
+  }
+  CHECK(pool->ngxSlabFreePages() < pages - 6);
+
+  CHECK(runChild(childFreeAll, sh));
+  CHECK(pool->ngxSlabStat(5).used_ == 0);
+  CHECK(pool->ngxSlabStat(8).used_ == 0);
+  //* 只剩 SlabShared 所在的一页，其余页合并回一整段，可以一次开辟
+  CHECK(pool->ngxSlabFreePages() == pages - 1);
+  void *run = pool->ngxSlabAlloc((pages - 1) * NGX_SLAB_PAGE_SIZE);
+  CHECK(run != nullptr);
+  pool->ngxSlabFree(run);
+
+  //* 接近 SIZE_MAX 的申请不能因页数计算回绕而成功，之后的开辟不受影响
+  CHECK(pool->ngxSlabAlloc(SIZE_MAX - 100) == nullptr);
+  CHECK(pool->ngxSlabCalloc(SIZE_MAX - 100) == nullptr);
+  CHECK(pool->ngxSlabFreePages() == pages - 1);
+  run = pool->ngxSlabAlloc((pages - 1) * NGX_SLAB_PAGE_SIZE);
+  CHECK(run != nullptr);
+  pool->ngxSlabFree(run);
+
+  CHECK(runChild(childDieLocked, sh));
+  void *p = pool->ngxSlabAlloc(64);
+  CHECK(p != nullptr);
+  pool->ngxSlabFree(p);
+  CHECK(pool->ngxSlabStat(6).used_ == 0);
+  ngxShmFree(shm, size, nullptr);
+  return true;
+}
+
+//* 同名共享内存已存在时创建失败，不截断其他进程正在使用的内容
+static bool testShmExclusive() {
+  char name[64];
+  snprintf(name, sizeof(name), "/ngx_test_shm_%d", (int)getpid());
+  const size_t size = 64 * 1024;
+  char *a = (char *)ngxShmAlloc(name, size, true);
+  CHECK(a != nullptr);
+  strcpy(a, "still mapped");
+  errno = 0;
+  CHECK(ngxShmAlloc(name, size, true) == nullptr);
+  CHECK(errno == EEXIST);
+  char *b = (char *)ngxShmAlloc(name, size, false);
+  CHECK(b != nullptr);
+  CHECK(strcmp(b, "still mapped") == 0);
+  ngxShmFree(b, size, nullptr);
+  ngxShmFree(a, size, name);
+  return true;
+}
+
+static void countCleanupAtomic(void *data) {
+  ++*(std::atomic<int> *)data;
+}
+
+//* 多个线程同时从一个并发内存池开辟小块内存、大块内存和清理记录：
+//* 各线程得到的内存互不重叠，大块内存可以由任意线程释放，析构时执行全部清理
+static bool testConcurrentPool() {
+  const int kThreads = 4;
+  const int kRounds = 2000;
+  std::atomic<int> cleanups{0};
+  std::vector<std::vector<std::pair<u_char *, size_t>>> small(kThreads);
+  std::vector<std::vector<void *>> large(kThreads);
+  {
+    NgxConcurrentMemPool pool(4096);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t] {
+        for (int i = 0; i < kRounds; ++i) {
+          size_t n = (size_t)(i * 37 + t * 11) % 200 + 1;
+          u_char *p = (u_char *)pool.ngxPalloc(n);
+          if (p == nullptr) {
+            return;
+          }
+          memset(p, t + 1, n);
+          small[t].emplace_back(p, n);
+          if (i % 50 == 0) {
+            void *l = pool.ngxPalloc(8192);
+            if (l == nullptr) {
+              return;
+            }
+            memset(l, t + 1, 8192);
+            large[t].push_back(l);
+            NgxPoolCleanup *c = pool.ngxCleanupAdd(0);
+            if (c == nullptr) {
+              return;
+            }
+            c->handler_ = countCleanupAtomic;
+            c->data_ = &cleanups;
+          }
+        }
+      });
+    }
+    for (std::thread &th : threads) {
+      th.join();
+    }
+
+    size_t nlarge = 0;
+    for (int t = 0; t < kThreads; ++t) {
+      CHECK(small[t].size() == (size_t)kRounds);
+      for (auto &s : small[t]) {
+        for (size_t i = 0; i < s.second; ++i) {
+          CHECK(s.first[i] == t + 1);
+        }
+      }
+      for (void *l : large[t]) {
+        CHECK(((u_char *)l)[0] == t + 1 && ((u_char *)l)[8191] == t + 1);
+      }
+      nlarge += large[t].size();
+    }
+    CHECK(pool.ngxStats().largeCount_ == nlarge);
+
+    //* 每个线程释放另一个线程开辟的大块内存
+    threads.clear();
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&, t] {
+        for (void *l : large[(t + 1) % kThreads]) {
+          pool.ngxPfree(l);
+        }
+      });
+    }
+    for (std::thread &th : threads) {
+      th.join();
+    }
+    CHECK(pool.ngxStats().largeCount_ == 0);
+    CHECK(cleanups == 0);
+  }
+  CHECK(cleanups == kThreads * (kRounds / 50));
+  return true;
+}
+
+//* 统计开辟、归还次数的内存来源，用于观察块缓存是否命中
+class CountingSource : public PageSource {
+public:
+  void *allocate(size_t size) override {
+    ++allocs_;
+    return malloc(size);
+  }
+  void deallocate(void *p, size_t /* size */) override {
+    ++deallocs_;
+    free(p);
+  }
+
+  std::atomic<int> allocs_{0};
+  std::atomic<int> deallocs_{0};
+};
+
+//* 在新线程中运行，弹匣从空开始，不受之前测试留下的块影响
+static bool runInThread(bool (*fn)()) {
+  bool ok = false;
+  std::thread th([&ok, fn] { ok = fn(); });
+  th.join();
+  return ok;
+}
+
+//* 还回的块留在本线程弹匣中，下一次同样大小的取用直接命中，不再向内存来源申请
+static bool cacheMagazineHit() {
+  NgxBlockCache &cache = NgxBlockCache::instance();
+  CountingSource src;
+  void *p = cache.get(&src, 4096);
+  CHECK(p != nullptr && src.allocs_ == 1);
+  cache.put(&src, p, 4096);
+  CHECK(src.deallocs_ == 0);
+  CHECK(cache.get(&src, 4096) == p);
+  CHECK(src.allocs_ == 1);
+  //* 大小不同的块不会混用
+  void *q = cache.get(&src, 8192);
+  CHECK(q != nullptr && q != p && src.allocs_ == 2);
+  cache.put(&src, p, 4096);
+  cache.put(&src, q, 8192);
+  cache.release(&src);
+  CHECK(src.deallocs_ == 2);
+  return true;
+}
+
+//* 弹匣满时半匣交还全局仓库，弹匣取空后从仓库取一块并补充半匣
+static bool cacheDepotRefill() {
+  NgxBlockCache &cache = NgxBlockCache::instance();
+  const size_t kSize = 4096;
+  const int n = NgxBlockCache::kMagazineSize + 1;
+  CountingSource src;
+  std::vector<void *> blocks;
+  for (int i = 0; i < n; ++i) {
+    blocks.push_back(cache.get(&src, kSize));
+  }
+  size_t before = cache.cachedBytes();
+  for (void *p : blocks) {
+    cache.put(&src, p, kSize);
+  }
+  //* 第 kMagazineSize + 1 块放入前，半匣进入仓库
+  const int depot = NgxBlockCache::kMagazineSize / 2;
+  const int magazine = n - depot;
+  CHECK(cache.cachedBytes() == before + depot * kSize);
+
+  blocks.clear();
+  for (int i = 0; i < magazine; ++i) {
+    blocks.push_back(cache.get(&src, kSize));
+  }
+  CHECK(cache.cachedBytes() == before + depot * kSize);
+  //* 弹匣已空：取走仓库中的一块，其余补进弹匣
+  blocks.push_back(cache.get(&src, kSize));
+  CHECK(cache.cachedBytes() == before);
+  for (int i = 1; i < depot; ++i) {
+    blocks.push_back(cache.get(&src, kSize));
+  }
+  CHECK(src.allocs_ == n);
+  blocks.push_back(cache.get(&src, kSize));
+  CHECK(src.allocs_ == n + 1);
+  CHECK(src.deallocs_ == 0);
+  for (void *p : blocks) {
+    CHECK(p != nullptr);
+    cache.put(&src, p, kSize);
+  }
+  cache.release(&src);
+  CHECK(src.deallocs_ == n + 1);
+  return true;
+}
+
+//* 仓库缓存的字节数不超过上限，多出的块直接还给内存来源；上限为 0 时不缓存
+static bool cacheHighWater() {
+  NgxBlockCache &cache = NgxBlockCache::instance();
+  const size_t kSize = 4096;
+  CountingSource src;
+  std::vector<void *> blocks;
+  for (int i = 0; i < NgxBlockCache::kMagazineSize * 2; ++i) {
+    blocks.push_back(cache.get(&src, kSize));
+  }
+
+  //* 先清空仓库中之前的测试留下的块，超出上限时丢弃哪些块才是确定的
+  cache.setHighWater(0);
+  CHECK(cache.cachedBytes() == 0);
+  cache.setHighWater(2 * kSize);
+  for (void *p : blocks) {
+    cache.put(&src, p, kSize);
+  }
+  CHECK(cache.cachedBytes() == 2 * kSize);
+  //* 两次各交还半匣，最终弹匣是满的，仓库留下 2 块，其余归还
+  CHECK(src.deallocs_ == NgxBlockCache::kMagazineSize - 2);
+
+  //* 调低上限时立即归还仓库中超出的块
+  cache.setHighWater(kSize);
+  CHECK(cache.cachedBytes() == kSize);
+  CHECK(src.deallocs_ == NgxBlockCache::kMagazineSize - 1);
+
+  cache.setHighWater(0);
+  void *p = cache.get(&src, 8192);
+  cache.put(&src, p, 8192);
+  CHECK(cache.cachedBytes() == 0);
+  CHECK(src.deallocs_ == NgxBlockCache::kMagazineSize + 1);
+
+  cache.setHighWater(NgxBlockCache::kDefaultHighWater);
+  cache.release(&src);
+  CHECK(src.deallocs_ == src.allocs_);
+  return true;
+}
+
+static bool testBlockCache() {
+  CHECK(NgxBlockCache::kDefaultHighWater == 64 * 1024 * 1024);
+  CHECK(NgxBlockCache::instance().highWater() == NgxBlockCache::kDefaultHighWater);
+  CHECK(runInThread(cacheMagazineHit));
+  CHECK(runInThread(cacheDepotRefill));
+  CHECK(runInThread(cacheHighWater));
+  return true;
+}
+
+//* 线程退出时弹匣中的块交还全局仓库，其他线程可以取用
+static bool testCacheThreadExit() {
+  NgxBlockCache &cache = NgxBlockCache::instance();
+  const size_t kSize = 4096;
+  CountingSource src;
+  size_t before = cache.cachedBytes();
+  std::thread th([&] {
+    void *blocks[3];
+    for (void *&p : blocks) {
+      p = cache.get(&src, kSize);
+    }
+    for (void *p : blocks) {
+      cache.put(&src, p, kSize);
+    }
+  });
+  th.join();
+  CHECK(cache.cachedBytes() == before + 3 * kSize);
+  CHECK(src.allocs_ == 3 && src.deallocs_ == 0);
+
+  void *taken[3];
+  std::thread other([&] {
+    for (void *&p : taken) {
+      p = cache.get(&src, kSize);
+    }
+  });
+  other.join();
+  CHECK(cache.cachedBytes() == before);
+  CHECK(src.allocs_ == 3);
+  for (void *p : taken) {
+    src.deallocate(p, kSize);
+  }
+  return true;
+}
+
+//* 内存池析构时内存块进入块缓存而不是还给内存来源，下一个同样大小的内存池直接复用
+static bool poolDestructorCaches() {
+  CountingSource src;
+  for (int round = 0; round < 2; ++round) {
+    NgxMemPool pool(4096, &src);
+    for (int i = 0; i < 40; ++i) {
+      CHECK(pool.ngxPalloc(256) != nullptr);
+    }
+    CHECK(pool.ngxStats().blockCount_ > 1);
+  }
+  int allocs = src.allocs_;
+  CHECK(src.deallocs_ == 0);
+  {
+    NgxMemPool pool(4096, &src);
+    for (int i = 0; i < 40; ++i) {
+      CHECK(pool.ngxPalloc(256) != nullptr);
+    }
+  }
+  CHECK(src.allocs_ == allocs);
+  CHECK(src.deallocs_ == 0);
+  NgxBlockCache::instance().release(&src);
+  CHECK(src.deallocs_ == src.allocs_);
+  return true;
+}
+
+static bool testCachePoolDestructor() {
+  return runInThread(poolDestructorCaches);
+}
+
+//* release 交还所有线程弹匣中属于该来源的块：另一个线程之后既不会再取到这些块，
+//* 也不会在退出时把它们交还仓库或还给已经销毁的来源
+static bool testCacheReleaseThreads() {
+  NgxBlockCache &cache = NgxBlockCache::instance();
+  const size_t kSize = 4096;
+  CountingSource *src = new CountingSource();
+  std::atomic<int> step{0};
+  void *reused = nullptr;
+  std::thread th([&] {
+    void *blocks[3];
+    for (void *&p : blocks) {
+      p = cache.get(src, kSize);
+    }
+    for (void *p : blocks) {
+      cache.put(src, p, kSize);
+    }
+    step = 1;
+    while (step != 2) {
+      std::this_thread::yield();
+    }
+    reused = cache.get(src, kSize);
+    cache.put(src, reused, kSize);
+    step = 3;
+    while (step != 4) {
+      std::this_thread::yield();
+    }
+  });
+  while (step != 1) {
+    std::this_thread::yield();
+  }
+  size_t before = cache.cachedBytes();
+  cache.release(src);
+  CHECK(src->allocs_ == 3 && src->deallocs_ == 3);
+
+  //* 弹匣已清空，再次取用向内存来源申请新块
+  step = 2;
+  while (step != 3) {
+    std::this_thread::yield();
+  }
+  CHECK(src->allocs_ == 4);
+  cache.release(src);
+  CHECK(src->deallocs_ == 4);
+  delete src;
+
+  step = 4;
+  th.join();
+  CHECK(cache.cachedBytes() == before);
+  return true;
+}
+
+int main() {
+  struct {
+    const char *name;
+    bool (*fn)();
+  } tests[] = {
+    {"example", testExample},
+    {"rollback", testRollback},
+    {"aligned large", testAlignedLarge},
+    {"large hash erase", testLargeHashErase},
+    {"large buckets", testLargeBuckets},
+    {"set max small", testSetMaxSmall},
+    {"array growth", testArrayGrowth},
+    {"buf pipe", testBufPipe},
+    {"buf socketpair", testBufSocketpair},
+    {"slab fork", testSlabFork},
+    {"shm exclusive", testShmExclusive},
+    {"concurrent pool", testConcurrentPool},
+    {"block cache", testBlockCache},
+    {"cache thread exit", testCacheThreadExit},
+    {"cache pool destructor", testCachePoolDestructor},
+    {"cache release threads", testCacheReleaseThreads},
+  };
+
+  int failed = 0;
+  for (auto &t : tests) {
+    bool ok = t.fn();
+    printf("%s: %s\n", t.name, ok ? "ok" : "FAILED");
+    failed += !ok;
+  }
+  return failed;
 }
\ No newline at end of file
@@ -0,0 +1,287 @@
+//* 通过 LD_PRELOAD 注入 libsgi_stl_malloc.so 后运行，覆盖替换的各个 malloc 接口
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return false;                                                   \
+    }                                                                 \
+  } while (0)
+
+//* 避免编译器按常量推断出申请必然失败而给出警告或直接删掉调用
+static volatile size_t kHuge = SIZE_MAX - 10;
+
+static bool filled(const void *p, int c, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (((const unsigned char *)p)[i] != (unsigned char)c) return false;
+  }
+  return true;
+}
+
+//* 100 字节落在 112 字节的类别，glibc 给出的可用字节数不同，据此确认替换已经生效
+static bool testPreloaded() {
+  void *p = malloc(100);
+  CHECK(p != nullptr);
+  CHECK(malloc_usable_size(p) == 112);
+  free(p);
+  return true;
+}
+
+//* 小块与大块内存的开辟、写入、释放，可用字节数不小于申请的字节数
+static bool testMallocFree() {
+  std::vector<void *> ptrs;
+  for (size_t n = 1; n <= 70000; n = n * 3 / 2 + 1) {
+    void *p = malloc(n);
+    CHECK(p != nullptr);
+    CHECK((size_t)p % 16 == 0 || n < 16);
+    CHECK(malloc_usable_size(p) >= n);
+    memset(p, (int)(n & 0xff), n);
+    ptrs.push_back(p);
+  }
+  size_t i = 0;
+  for (size_t n = 1; n <= 70000; n = n * 3 / 2 + 1) {
+    CHECK(filled(ptrs[i], (int)(n & 0xff), n));
+    free(ptrs[i++]);
+  }
+  free(nullptr);
+  CHECK(malloc_usable_size(nullptr) == 0);
+  return true;
+}
+
+//* calloc 复用弄脏的节点时也要清零；元素个数乘尺寸溢出时失败
+static bool testCalloc() {
+  void *dirty = malloc(64);
+  memset(dirty, 0xff, 64);
+  free(dirty);
+  void *p = calloc(8, 8);
+  CHECK(p != nullptr);
+  CHECK(filled(p, 0, 64));
+  free(p);
+
+  void *large = calloc(1, 100000);
+  CHECK(large != nullptr);
+  CHECK(filled(large, 0, 100000));
+  free(large);
+
+  errno = 0;
+  CHECK(calloc(kHuge, 16) == nullptr);
+  CHECK(errno == ENOMEM);
+  return true;
+}
+
+//* realloc 在类别之间、类别与大块内存之间搬移时保留内容
+static bool testRealloc() {
+  char *p = (char *)realloc(nullptr, 10);
+  CHECK(p != nullptr);
+  memset(p, 0x11, 10);
+  const size_t sizes[] = {12, 200, 5000, 100000, 300, 7};
+  size_t old = 10;
+  for (size_t n : sizes) {
+    p = (char *)realloc(p, n);
+    CHECK(p != nullptr);
+    CHECK(filled(p, 0x11, old < n ? old : n));
+    memset(p, 0x11, n);
+    old = n;
+  }
+  CHECK(realloc(p, 0) == nullptr);
+
+  int *arr = (int *)reallocarray(nullptr, 100, sizeof(int));
+  CHECK(arr != nullptr);
+  errno = 0;
+  CHECK(reallocarray(arr, kHuge, sizeof(int)) == nullptr);
+  CHECK(errno == ENOMEM);
+  free(arr);
+  return true;
+}
+
+//* 注入之前由原来的分配器开辟的内存交给原来的 realloc，内容保留
+static bool testForeignRealloc() {
+  typedef void *(*MallocFn)(size_t);
+  typedef void (*FreeFn)(void *);
+  //* 注入的库排在可执行文件之后，RTLD_NEXT 找到的仍是替换的 malloc，直接从 libc 中查找
+  void *libc = dlopen("libc.so.6", RTLD_LAZY | RTLD_NOLOAD);
+  CHECK(libc != nullptr);
+  MallocFn libcMalloc = (MallocFn)dlsym(libc, "malloc");
+  FreeFn libcFree = (FreeFn)dlsym(libc, "free");
+  CHECK(libcMalloc != nullptr && libcFree != nullptr);
+  char *p = (char *)libcMalloc(40);
+  CHECK(p != nullptr);
+  CHECK(malloc_usable_size(p) == 0);
+  memset(p, 0x22, 40);
+  char *q = (char *)realloc(p, 4000);
+  CHECK(q != nullptr);
+  CHECK(filled(q, 0x22, 40));
+  libcFree(q);
+  dlclose(libc);
+  return true;
+}
+
+//* 16 到 8192 的每个对齐都满足，对齐不是 2 的幂时报错
+static bool testMemalign() {
+  for (size_t align = 16; align <= 8192; align *= 2) {
+    for (size_t n : {(size_t)1, align, (size_t)3000, (size_t)50000}) {
+      void *p = nullptr;
+      CHECK(posix_memalign(&p, align, n) == 0);
+      CHECK((size_t)p % align == 0);
+      memset(p, 0x33, n);
+      free(p);
+
+      p = aligned_alloc(align, n);
+      CHECK(p != nullptr && (size_t)p % align == 0);
+      free(p);
+      p = memalign(align, n);
+      CHECK(p != nullptr && (size_t)p % align == 0);
+      free(p);
+    }
+  }
+  void *p = nullptr;
+  CHECK(posix_memalign(&p, 24, 16) == EINVAL);
+  CHECK(aligned_alloc(24, 16) == nullptr);
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  p = valloc(100);
+  CHECK(p != nullptr && (size_t)p % page == 0);
+  free(p);
+  p = pvalloc(page + 1);
+  CHECK(p != nullptr && (size_t)p % page == 0);
+  CHECK(malloc_usable_size(p) >= 2 * page);
+  free(p);
+  return true;
+}
+
+//* 尺寸计算溢出时返回空并置 ENOMEM，realloc 失败时原内存保持不变
+static bool testOverflow() {
+  char *p = (char *)malloc(16);
+  CHECK(p != nullptr);
+  memset(p, 0x44, 16);
+  errno = 0;
+  CHECK(realloc(p, kHuge) == nullptr);
+  CHECK(errno == ENOMEM);
+  CHECK(filled(p, 0x44, 16));
+  free(p);
+
+  errno = 0;
+  CHECK(pvalloc(kHuge) == nullptr);
+  CHECK(errno == ENOMEM);
+  errno = 0;
+  CHECK(malloc(kHuge) == nullptr);
+  CHECK(errno == ENOMEM);
+  void *q = &q;
+  CHECK(posix_memalign(&q, 64, kHuge) == ENOMEM);
+  return true;
+}
+
+//* 地址空间耗尽时 chunk 开辟失败，malloc 返回空而不是退出进程，之后释放的节点仍可再次开辟
+static bool childOutOfMemory() {
+  long pages = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  CHECK(statm != nullptr);
+  CHECK(fscanf(statm, "%ld", &pages) == 1);
+  fclose(statm);
+  struct rlimit limit;
+  limit.rlim_cur = limit.rlim_max = (rlim_t)pages * sysconf(_SC_PAGESIZE) + (64 << 20);
+  CHECK(setrlimit(RLIMIT_AS, &limit) == 0);
+
+  std::vector<void *> ptrs;
+  ptrs.reserve(1 << 20);
+  void *p = nullptr;
+  errno = 0;
+  while (ptrs.size() < ptrs.capacity() && (p = malloc(1000)) != nullptr) {
+    ptrs.push_back(p);
+  }
+  CHECK(p == nullptr);
+  CHECK(errno == ENOMEM);
+  CHECK(malloc(1 << 28) == nullptr);
+
+  free(ptrs.back());
+  ptrs.pop_back();
+  p = malloc(1000);
+  CHECK(p != nullptr);
+  memset(p, 0x55, 1000);
+  return true;
+}
+
+static bool testOutOfMemory() {
+  pid_t pid = fork();
+  if (pid == 0) {
+    _exit(childOutOfMemory() ? 0 : 1);
+  }
+  int status = 0;
+  CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return true;
+}
+
+//* 多个线程同时开辟、释放各种尺寸
+static bool testThreads() {
+  bool ok[4] = {};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&ok, t] {
+      std::vector<std::pair<char *, size_t>> held;
+      ok[t] = true;
+      for (int i = 0; i < 20000; ++i) {
+        size_t n = (size_t)((i * 7919 + t * 104729) % 40000) + 1;
+        char *p = (char *)malloc(n);
+        if (p == nullptr) {
+          ok[t] = false;
+          return;
+        }
+        memset(p, t, n);
+        held.emplace_back(p, n);
+        if (held.size() > 32) {
+          if (!filled(held.front().first, t, held.front().second)) ok[t] = false;
+          free(held.front().first);
+          held.erase(held.begin());
+        }
+      }
+      for (auto &h : held) {
+        free(h.first);
+      }
+    });
+  }
+  for (std::thread &th : threads) {
+    th.join();
+  }
+  for (bool b : ok) {
+    CHECK(b);
+  }
+  return true;
+}
+
+int main() {
+  struct {
+    const char *name;
+    bool (*fn)();
+  } tests[] = {
+    {"preloaded", testPreloaded},
+    {"malloc/free", testMallocFree},
+    {"calloc", testCalloc},
+    {"realloc", testRealloc},
+    {"foreign realloc", testForeignRealloc},
+    {"memalign", testMemalign},
+    {"overflow", testOverflow},
+    {"out of memory", testOutOfMemory},
+    {"threads", testThreads},
+  };
+
+  int failed = 0;
+  for (auto &t : tests) {
+    bool ok = t.fn();
+    printf("%s: %s\n", t.name, ok ? "ok" : "FAILED");
+    failed += !ok;
+  }
+  return failed;
+}
@@ -0,0 +1,609 @@
+#include "sgi_stl_mem_pool.hpp"
+#include "sgi_stl_node_reserve.hpp"
+
+#include <stdio.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace sgi_stl;
+
+#define CHECK(cond)                                                   \
+  do {                                                                \
+    if (!(cond)) {                                                    \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      return false;                                                   \
+    }                                                                 \
+  } while (0)
+
+//* 一个线程开辟、另一个只释放不开辟的线程归还：释放线程退出时缓存中的节点须交还全局自由链表，
+//* 之后 trim 能把所有 chunk 交还，不会留在已退出线程的缓存里
+static bool testFreeOnlyThread() {
+  Allocator<char> alloc;
+  std::vector<char *> ptrs;
+  for (int i = 0; i < 1000; ++i) {
+    ptrs.push_back(alloc.allocate(32));
+  }
+  std::thread([&] {
+    for (char *p : ptrs) {
+      alloc.deallocate(p, 32);
+    }
+  }).join();
+
+  CHECK(Allocator<char>::stats().heap_size > 0);
+#if !SGI_STL_REMOTE_FREE
+  //* 远程释放模式下节点回到所属线程的堆，段不交还，trim 不适用
+  CHECK(Allocator<char>::trim() > 0);
+  pool_stats s = Allocator<char>::stats();
+  CHECK(s.heap_size == 0);
+  CHECK(s.chunk_count == 0);
+#endif
+  return true;
+}
+
+//* 多个线程同时在同一个独立内存池的自由链表上弹出、压入节点(无锁模式下为带版本号的 CAS 栈)：
+//* 每个节点同一时刻只能交给一个线程，写入的内容在归还前不会被其他线程改动；
+//* 结束后链表上的节点互不相同，没有丢失或重复
+static bool testConcurrentPushPop() {
+  //* memory_resource 默认按 max_align_t 对齐，会转交上游，这里都显式按 8 字节申请
+  pool_resource<> res;
+  const int kThreads = 4;
+  const int kRounds = 20000;
+  const int kHeld = 8;
+  std::atomic<int> corrupted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      long *held[kHeld];
+      for (int r = 0; r < kRounds; ++r) {
+        for (int k = 0; k < kHeld; ++k) {
+          held[k] = (long *)res.allocate(64, 8);
+          held[k][0] = t;
+          held[k][1] = r * kHeld + k;
+        }
+        for (int k = 0; k < kHeld; ++k) {
+          if (held[k][0] != t || held[k][1] != r * kHeld + k) ++corrupted;
+          res.deallocate(held[k], 64, 8);
+        }
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  CHECK(corrupted == 0);
+
+  long unsigned int index = __pool_engine<default_size_class>::_S_freelist_index(64);
+  long unsigned int n = res.stats().classes[index].free_objects;
+  CHECK(n >= (long unsigned int)kHeld);
+  std::set<void *> seen;
+  for (long unsigned int i = 0; i < n; ++i) {
+    seen.insert(res.allocate(64, 8));
+  }
+  CHECK(seen.size() == n);
+  CHECK(res.stats().classes[index].free_objects == 0);
+  return true;
+}
+
+//* 尺寸类别表的通用性质：尺寸严格递增、是 8 的倍数(超过 1024 时是 128 的倍数)，
+//* _S_index 取到能容纳该字节数的最小类别，_S_floor_index 取到不超过它的最大类别
+template <typename SizeClass>
+static bool checkSizeClass() {
+  const int n = SizeClass::_S_nclasses;
+  CHECK(SizeClass::_S_size(0) == 8);
+  CHECK(SizeClass::_S_size(n - 1) == SizeClass::_S_max_bytes);
+  for (int i = 0; i < n; ++i) {
+    long unsigned int size = SizeClass::_S_size(i);
+    CHECK(size % (size > 1024 ? 128 : 8) == 0);
+    CHECK(i == 0 || SizeClass::_S_size(i - 1) < size);
+    CHECK(SizeClass::_S_batch(i) >= 2 && SizeClass::_S_batch(i) <= 20);
+  }
+  for (long unsigned int bytes = 1; bytes <= SizeClass::_S_max_bytes; ++bytes) {
+    long unsigned int i = SizeClass::_S_index(bytes);
+    CHECK(SizeClass::_S_size(i) >= bytes);
+    CHECK(i == 0 || SizeClass::_S_size(i - 1) < bytes);
+    int f = SizeClass::_S_floor_index(bytes);
+    CHECK(f == -1 ? bytes < 8 : SizeClass::_S_size(f) <= bytes);
+    CHECK(f + 1 == n || SizeClass::_S_size(f + 1) > bytes);
+  }
+  return true;
+}
+
+//* 默认划分与原 SGI STL 相同；tcmalloc 风格的划分 64 字节以内线性，之后每翻一倍四级
+static bool testSizeClasses() {
+  CHECK(checkSizeClass<default_size_class>());
+  CHECK(checkSizeClass<tcmalloc_size_class>());
+
+  CHECK(default_size_class::_S_nclasses == 16);
+  for (int i = 0; i < 16; ++i) {
+    CHECK(default_size_class::_S_size(i) == 8UL * (i + 1));
+  }
+
+  const long unsigned int expected[] = {8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128,
+                                        160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024,
+                                        1280, 1536, 1792, 2048, 2560, 3072, 3584, 4096};
+  const int count = sizeof(expected) / sizeof(expected[0]);
+  CHECK(tcmalloc_size_class::_S_nclasses == count);
+  for (int i = 0; i < count; ++i) {
+    CHECK(tcmalloc_size_class::_S_size(i) == expected[i]);
+  }
+  CHECK(tcmalloc_size_class::_S_index(65) == 8);
+  CHECK(tcmalloc_size_class::_S_index(1025) == 24);
+  CHECK(tcmalloc_size_class::_S_floor_index(1279) == 23);
+
+  //* 按 tcmalloc 划分的分配器能开辟到 4KB，快照中每个类别一项
+  Allocator<char, tcmalloc_size_class> alloc;
+  char *p = alloc.allocate(3000);
+  memset(p, 0x5a, 3000);
+  alloc.deallocate(p, 3000);
+  CHECK((Allocator<char, tcmalloc_size_class>::stats().classes.size() == (size_t)count));
+  return true;
+}
+
+struct Node24 {
+  long v[3];
+};
+
+//* 批量开辟得到互不相同的节点；预留之后逐个开辟同样个数的节点不再向内存来源申请新的 chunk
+static bool testBatchAndReserve() {
+  Allocator<Node24> alloc;
+  const int kCount = 300;
+  Node24 *nodes[kCount];
+  CHECK(alloc.allocate_batch(kCount, nodes) == (long unsigned int)kCount);
+  std::set<Node24 *> distinct(nodes, nodes + kCount);
+  CHECK(distinct.size() == (size_t)kCount);
+  for (int i = 0; i < kCount; ++i) {
+    CHECK(nodes[i] != nullptr);
+    nodes[i]->v[0] = nodes[i]->v[2] = i;
+  }
+  for (int i = 0; i < kCount; ++i) {
+    CHECK(nodes[i]->v[0] == i && nodes[i]->v[2] == i);
+  }
+  alloc.deallocate_batch(nodes, kCount);
+
+  const int kReserved = 500;
+  Allocator<Node24>::reserve(kReserved);
+  long unsigned int heap = Allocator<Node24>::stats().heap_size;
+  std::vector<Node24 *> reserved;
+  for (int i = 0; i < kReserved; ++i) {
+    reserved.push_back(alloc.allocate(1));
+  }
+  CHECK(Allocator<Node24>::stats().heap_size == heap);
+  for (Node24 *p : reserved) {
+    alloc.deallocate(p, 1);
+  }
+
+  //* 节点型容器按 rebind 出的节点类型预留
+  std::map<int, int, std::less<int>, Allocator<std::pair<const int, int>>> m;
+  reserve_nodes(m, 1000);
+  heap = Allocator<char>::stats().heap_size;
+  for (int i = 0; i < 1000; ++i) {
+    m[i] = i;
+  }
+  CHECK(Allocator<char>::stats().heap_size == heap);
+  CHECK(m.size() == 1000 && m[999] == 999);
+  return true;
+}
+
+//* 记录开辟、归还和交还物理页次数的内存来源，实际内存由 malloc 提供
+//* 无锁模式下休眠的 chunk 一直引用开辟它的来源，测试中的实例都是静态对象
+class CountingPageSource : public PageSource {
+public:
+  void *allocate(size_t size) override {
+    ++allocs_;
+    return malloc(size);
+  }
+  void deallocate(void *p, size_t /* size */) override {
+    ++deallocs_;
+    free(p);
+  }
+  void release(void *p, size_t size) override {
+    ++releases_;
+    PageSource::release(p, size);
+  }
+
+  std::atomic<int> allocs_{0};
+  std::atomic<int> deallocs_{0};
+  std::atomic<int> releases_{0};
+};
+
+//* 所有节点归还后 trim 交还全部 chunk：加锁模式下归还给内存来源；
+//* 无锁模式下只交还物理页，chunk 标记为休眠，不再计入快照，之后的申请优先复用它
+static bool testTrimDormant() {
+  static CountingPageSource source;
+  pool_resource<> res(std::pmr::get_default_resource(), &source);
+  std::set<char *> first;
+  for (int i = 0; i < 200; ++i) {
+    first.insert((char *)res.allocate(64, 8));
+  }
+  for (char *p : first) {
+    res.deallocate(p, 64, 8);
+  }
+  int allocs = source.allocs_;
+  CHECK(allocs > 0);
+
+  CHECK(res.trim() > 0);
+  pool_stats s = res.stats();
+  CHECK(s.heap_size == 0);
+  CHECK(s.chunk_count == 0);
+  CHECK(s.classes[__pool_engine<default_size_class>::_S_freelist_index(64)].free_objects == 0);
+#if SGI_STL_LOCK_FREE
+  CHECK(source.releases_ > 0);
+  CHECK(source.deallocs_ == 0);
+  char *again = (char *)res.allocate(64, 8);
+  CHECK(first.count(again) == 1);
+  CHECK(source.allocs_ == allocs);
+  CHECK(res.stats().chunk_count > 0);
+  res.deallocate(again, 64, 8);
+#else
+  CHECK(source.deallocs_ == allocs);
+#endif
+  return true;
+}
+
+//* 切换内存来源只影响之后新开辟的 chunk，已有的 chunk 在 trim 时仍交还给开辟它的来源
+//* 按 16 字节对齐的申请由对齐实例提供，在各种缓存配置下都直接从 chunk 切分；单独的尺寸类别避免受其他测试影响
+static bool testPageSourceSwap() {
+  typedef Allocator<char, __size_class<256>> Alloc;
+  static CountingPageSource a;
+  static CountingPageSource b;
+  Alloc alloc;
+  std::vector<void *> ptrs;
+
+  Alloc::set_page_source(&a);
+  ptrs.push_back(alloc.allocate_bytes(256, 16));
+  CHECK(a.allocs_ > 0);
+  int allocs = a.allocs_;
+
+  Alloc::set_page_source(&b);
+  for (int i = 0; i < 100000 && b.allocs_ == 0; ++i) {
+    ptrs.push_back(alloc.allocate_bytes(256, 16));
+  }
+  CHECK(b.allocs_ > 0);
+  CHECK(a.allocs_ == allocs);
+
+  for (void *p : ptrs) {
+    alloc.deallocate_bytes(p, 256, 16);
+  }
+  CHECK(Alloc::trim() > 0);
+#if SGI_STL_LOCK_FREE
+  CHECK(a.releases_ > 0 && b.releases_ > 0);
+#else
+  CHECK(a.deallocs_ == a.allocs_);
+  CHECK(b.deallocs_ == b.allocs_);
+#endif
+  Alloc::set_page_source(nullptr);
+  return true;
+}
+
+//* 快照中的各项计数与实际开辟、释放的节点一致
+static bool testStats() {
+  pool_resource<> res;
+  const long unsigned int index = __pool_engine<default_size_class>::_S_freelist_index(32);
+  void *ptrs[10];
+  for (void *&p : ptrs) {
+    p = res.allocate(32, 8);
+  }
+  pool_stats s = res.stats();
+  const pool_stats::size_class_stats &c = s.classes[index];
+  CHECK(c.size == 32);
+  CHECK(s.chunk_count >= 1);
+  CHECK(s.free_list_bytes == c.free_objects * 32);
+  CHECK(s.free_list_bytes + s.pool_left_bytes + 10 * 32 <= s.heap_size);
+#if SGI_STL_STATS
+  CHECK(c.hits + c.misses == 10);
+  CHECK(c.misses >= 1);
+  CHECK(c.refills == c.misses);
+#endif
+  long unsigned int free_objects = c.free_objects;
+  for (void *p : ptrs) {
+    res.deallocate(p, 32, 8);
+  }
+  CHECK(res.stats().classes[index].free_objects == free_objects + 10);
+  CHECK(s.to_string().find("sgi_stl_pool_free_objects{size=\"32\"}") != std::string::npos);
+
+  //* 全局内存池的命中与未命中还包括线程缓存或每 CPU 缓存中的计数
+  typedef Allocator<char, __size_class<64>> Alloc;
+  Alloc alloc;
+  char *p = alloc.allocate(16);
+  char *q = alloc.allocate(16);
+  alloc.deallocate(p, 16);
+  alloc.deallocate(q, 16);
+  pool_stats g = Alloc::stats();
+  CHECK(g.heap_size > 0);
+#if SGI_STL_STATS
+  const pool_stats::size_class_stats &gc = g.classes[1];
+  CHECK(gc.size == 16);
+  CHECK(gc.hits + gc.misses == 2);
+  CHECK(gc.misses >= 1);
+#if SGI_STL_THREAD_CACHE || SGI_STL_PER_CPU
+  CHECK(gc.cached_objects >= 2);
+  CHECK(g.cached_bytes == gc.cached_objects * 16);
+#endif
+#endif
+  return true;
+}
+
+//* 慢启动：每个类别第一次补充 2 个节点，之后每补充一次翻倍，直到批量搬运个数的 8 倍；trim 后重新开始
+static bool testSlowStart() {
+  typedef __pool_engine<default_size_class> Engine;
+  pool_resource<> res;
+  const long unsigned int index = Engine::_S_freelist_index(32);
+  const long unsigned int cap = Engine::_REFILL_GROWTH * default_size_class::_S_batch(index);
+  auto refillObjects = [&] { return res.stats().classes[index].refill_objects; };
+
+  CHECK(refillObjects() == Engine::_REFILL_START);
+  std::vector<void *> ptrs;
+  ptrs.push_back(res.allocate(32, 8));
+  CHECK(refillObjects() == 4);
+  ptrs.push_back(res.allocate(32, 8));
+  CHECK(refillObjects() == 4);
+  ptrs.push_back(res.allocate(32, 8));
+  CHECK(refillObjects() == 8);
+
+  //* 2 + 4 + 8 + ... 个节点用完后达到上限，不再增长
+  for (int i = 0; i < 2000; ++i) {
+    ptrs.push_back(res.allocate(32, 8));
+  }
+  CHECK(refillObjects() == cap);
+
+  for (void *p : ptrs) {
+    res.deallocate(p, 32, 8);
+  }
+  CHECK(res.trim() > 0);
+  CHECK(refillObjects() == Engine::_REFILL_START);
+  return true;
+}
+
+#if SGI_STL_PER_CPU
+//* 在固定于 cpu 上的新线程中运行 fn，无法设置亲和性时返回 false
+template <typename Fn>
+static bool runOnCpu(int cpu, Fn fn) {
+  bool pinned = false;
+  std::thread([&] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0 || sched_getcpu() != cpu) return;
+    pinned = true;
+    fn();
+  }).join();
+  return pinned;
+}
+
+//* 每 CPU 缓存按线程当前所在的 CPU 选择：同一 CPU 上的线程先后使用同一份缓存，
+//* 一个线程释放的节点由同一 CPU 上的下一个线程取到，不会出现在其他 CPU 的缓存中
+static bool testPerCpuArena() {
+  typedef Allocator<char, __size_class<96>> Alloc;
+  cpu_set_t allowed;
+  CHECK(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+  int cpus[2] = {-1, -1};
+  for (int cpu = 0, n = 0; cpu < CPU_SETSIZE && n < 2; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed)) cpus[n++] = cpu;
+  }
+
+  Alloc alloc;
+  char *freed = nullptr;
+  if (!runOnCpu(cpus[0], [&] {
+        freed = alloc.allocate(48);
+        alloc.deallocate(freed, 48);
+      })) {
+    printf("per-cpu arena: cannot pin threads, skipped\n");
+    return true;
+  }
+  char *same = nullptr;
+  CHECK(runOnCpu(cpus[0], [&] { same = alloc.allocate(48); }));
+  CHECK(same == freed);
+  if (cpus[1] >= 0) {
+    char *other = nullptr;
+    CHECK(runOnCpu(cpus[1], [&] { other = alloc.allocate(48); }));
+    CHECK(other != freed);
+    alloc.deallocate(other, 48);
+  }
+  alloc.deallocate(same, 48);
+  return true;
+}
+#endif
+
+//* 记录申请次数的上游 memory_resource
+class CountingResource : public std::pmr::memory_resource {
+public:
+  int allocs_ = 0;
+  int deallocs_ = 0;
+
+protected:
+  void *do_allocate(size_t bytes, size_t align) override {
+    ++allocs_;
+    return std::pmr::new_delete_resource()->allocate(bytes, align);
+  }
+  void do_deallocate(void *p, size_t bytes, size_t align) override {
+    ++deallocs_;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+};
+
+//* 独立内存池析构时交还全部 chunk，即使其中的节点没有逐个释放；
+//* 超过 _MAX_BYTES 或对齐超过 8 字节的申请转交上游，其余都从自己的 chunk 中切分
+static bool testPoolResource() {
+  static CountingPageSource source;
+  CountingResource upstream;
+  {
+    pool_resource<> res(&upstream, &source);
+    CHECK(res.upstream_resource() == &upstream);
+    std::pmr::vector<long> v(&res);
+    for (long i = 0; i < 10; ++i) {
+      CHECK(res.allocate(64, 8) != nullptr);
+    }
+    CHECK(upstream.allocs_ == 0);
+    CHECK(source.allocs_ > 0);
+
+    void *large = res.allocate(200, 8);
+    void *aligned = res.allocate(16, 64);
+    CHECK(upstream.allocs_ == 2);
+    CHECK((long unsigned int)aligned % 64 == 0);
+    res.deallocate(large, 200, 8);
+    res.deallocate(aligned, 16, 64);
+    CHECK(upstream.deallocs_ == 2);
+
+    //* pmr 容器按 alignof(long) 申请，元素从本实例的 chunk 中切分
+    v.push_back(1);
+    CHECK(upstream.allocs_ == 2);
+  }
+  CHECK(source.deallocs_ == source.allocs_);
+  return true;
+}
+
+struct alignas(64) Line64 {
+  char bytes[64];
+};
+
+//* allocate_bytes 对 16 到 4096 的每个对齐都返回对齐的地址，包括超过 _MAX_BYTES 的申请；
+//* alignof(T) 超过 8 的类型在 allocate 和 reallocate 之后仍然对齐，内容保留
+static bool testAlignedBytes() {
+  Allocator<char> alloc;
+  const long unsigned int sizes[] = {1, 24, 100, 128, 4000};
+  for (long unsigned int align = 16; align <= 4096; align *= 2) {
+    std::vector<char *> ptrs;
+    for (long unsigned int size : sizes) {
+      for (int k = 0; k < 3; ++k) {
+        char *p = (char *)alloc.allocate_bytes(size, align);
+        CHECK((long unsigned int)p % align == 0);
+        memset(p, 0x5a, size);
+        ptrs.push_back(p);
+      }
+    }
+    size_t i = 0;
+    for (long unsigned int size : sizes) {
+      for (int k = 0; k < 3; ++k) {
+        alloc.deallocate_bytes(ptrs[i++], size, align);
+      }
+    }
+  }
+
+  Allocator<Line64> lines;
+  Line64 *l = lines.allocate(1);
+  CHECK((long unsigned int)l % 64 == 0);
+  memset(l, 0x3c, sizeof(Line64));
+  Line64 *grown = (Line64 *)lines.reallocate(l, sizeof(Line64), 3 * sizeof(Line64));
+  CHECK((long unsigned int)grown % 64 == 0);
+  CHECK(grown->bytes[0] == 0x3c && grown->bytes[63] == 0x3c);
+  Line64 *huge = (Line64 *)lines.reallocate(grown, 3 * sizeof(Line64), 8 * sizeof(Line64));
+  CHECK((long unsigned int)huge % 64 == 0);
+  CHECK(huge->bytes[0] == 0x3c && huge->bytes[63] == 0x3c);
+  lines.deallocate(huge, 8);
+  return true;
+}
+
+#if SGI_STL_REMOTE_FREE
+//* 多个线程同时释放同一个线程开辟的节点，节点压入所属堆的队列；
+//* 所属线程之后的申请从队列中取回这些节点，不开辟新的段
+static bool testRemoteFree() {
+  Allocator<char> alloc;
+  const int kCount = 2000;
+  const int kThreads = 3;
+  std::vector<char *> ptrs;
+  for (int i = 0; i < kCount; ++i) {
+    ptrs.push_back(alloc.allocate(48));
+  }
+  std::set<char *> freed(ptrs.begin(), ptrs.end());
+  long unsigned int heap = Allocator<char>::stats().heap_size;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = t; i < kCount; i += kThreads) {
+        alloc.deallocate(ptrs[i], 48);
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+
+  //* 先用完本线程缓存中剩下的不到一批节点，其余都来自队列
+  int reused = 0;
+  ptrs.clear();
+  for (int i = 0; i < kCount; ++i) {
+    char *p = alloc.allocate(48);
+    reused += freed.count(p);
+    ptrs.push_back(p);
+  }
+  CHECK(reused >= kCount - default_size_class::_S_batch(default_size_class::_S_index(48)));
+  CHECK(Allocator<char>::stats().heap_size == heap);
+  for (char *p : ptrs) {
+    alloc.deallocate(p, 48);
+  }
+  return true;
+}
+
+//* 线程退出后它的堆登记为无主，下一个开辟内存的线程接管该堆：
+//* 退出线程缓存中的节点回到使用中，它留下未释放的节点由接管的线程当作本线程的节点释放
+static bool testAbandonedHeap() {
+  Allocator<char> alloc;
+  std::set<char *> cached;
+  std::vector<char *> kept;
+  std::thread([&] {
+    for (int i = 0; i < 100; ++i) {
+      char *p = alloc.allocate(48);
+      if (i < 10) {
+        kept.push_back(p);
+      } else {
+        cached.insert(p);
+      }
+    }
+    for (char *p : cached) {
+      alloc.deallocate(p, 48);
+    }
+  }).join();
+  long unsigned int heap = Allocator<char>::stats().heap_size;
+
+  bool adopted = false;
+  std::thread([&] {
+    char *p = alloc.allocate(48);
+    adopted = cached.count(p) == 1;
+    alloc.deallocate(p, 48);
+    for (char *q : kept) {
+      alloc.deallocate(q, 48);
+    }
+  }).join();
+  CHECK(adopted);
+  CHECK(Allocator<char>::stats().heap_size == heap);
+  return true;
+}
+#endif
+
+int main() {
+  struct {
+    const char *name;
+    bool (*fn)();
+  } tests[] = {
+    {"free only thread", testFreeOnlyThread},
+    {"concurrent push/pop", testConcurrentPushPop},
+    {"size classes", testSizeClasses},
+    {"batch and reserve", testBatchAndReserve},
+    {"trim dormant chunks", testTrimDormant},
+    {"page source swap", testPageSourceSwap},
+    {"stats", testStats},
+    {"slow start", testSlowStart},
+#if SGI_STL_PER_CPU
+    {"per-cpu arena", testPerCpuArena},
+#endif
+    {"pool resource", testPoolResource},
+    {"aligned bytes", testAlignedBytes},
+#if SGI_STL_REMOTE_FREE
+    {"remote free", testRemoteFree},
+    {"abandoned heap", testAbandonedHeap},
+#endif
+  };
+
+  int failed = 0;
+  for (auto &t : tests) {
+    bool ok = t.fn();
+    printf("%s: %s\n", t.name, ok ? "ok" : "FAILED");
+    failed += !ok;
+  }
+  return failed;
+}